@@ -12,7 +12,18 @@
                 "src/NodePopplerDocument.cc",
                 "src/NodePopplerPage.cc",
                 "src/iconv_string.cc",
-                "src/MemoryStream.cc"
+                "src/MemoryStream.cc",
+                "src/RenderContextPool.cc",
+                "src/RenderPool.cc",
+                "src/TextIndex.cc",
+                "src/NodeTextIndex.cc",
+                "src/AhoCorasick.cc",
+                "src/TextLayoutCache.cc",
+                "src/RenderCache.cc",
+                "src/Sha256.cc",
+                "src/ProgressQueue.cc",
+                "src/ChunkStream.cc",
+                "src/RangeLoader.cc"
             ],
             "libraries": [
                 "<!@(pkg-config --libs poppler)"
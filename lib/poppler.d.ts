@@ -55,6 +55,34 @@ export interface Word extends RelRect {
     text: string,
 }
 
+/**
+ * Options for `getWordList`.
+ */
+export interface WordListOptions<F extends 'objects' | 'columnar'> {
+    /** Keep words in content stream order (default `false`). */
+    rawOrder?: boolean,
+    /**
+     * `'objects'` (default) returns a `Word` per word, `'columnar'` packs
+     * all words into a `ColumnarWordList`.
+     */
+    format?: F,
+}
+
+/**
+ * Words of a page packed into three allocations.
+ *
+ * Word `i` has bounding box `bboxes[4 * i]` .. `bboxes[4 * i + 3]`
+ * (`x1`, `y1`, `x2`, `y2` as in `RelRect`) and its text is
+ * `text.toString('utf8', offsets[i], offsets[i + 1])`.
+ */
+export interface ColumnarWordList {
+    bboxes: Float64Array,
+    /** Byte offsets into `text`, one more than the number of words. */
+    offsets: Uint32Array,
+    /** UTF-8 text of all words, without separators. */
+    text: Buffer,
+}
+
 /**
  * Represents a slice of a page.
  *
@@ -101,7 +129,65 @@ export interface BufferRenderResult {
     data: Buffer,
 }
 
-export type RenderResult = FileRenderResult | BufferRenderResult
+/**
+ * Represents a result of a `renderToBuffer('raw', ...)` operation.
+ */
+export interface RawRenderResult {
+    type: 'buffer',
+    format: 'raw',
+    /**
+     * Unencoded pixel rows, top to bottom. Each row is `stride` bytes long
+     * and may be padded at the end.
+     */
+    data: Buffer,
+    /** Image width in pixels. */
+    width: number,
+    /** Image height in pixels. */
+    height: number,
+    /** Length of a row in bytes. */
+    stride: number,
+    /** Pixel layout: 3, 4 or 1 bytes per pixel. */
+    colorMode: RawColorMode,
+}
+
+/**
+ * A tile delivered by `renderTiles`.
+ */
+export interface TileRenderResult extends BufferRenderResult {
+    /** Column of the tile. */
+    x: number,
+    /** Row of the tile. */
+    y: number,
+    /** Width in pixels, less than `tileSize` at the right edge of the page. */
+    width: number,
+    /** Height in pixels, less than `tileSize` at the bottom edge of the page. */
+    height: number,
+}
+
+/**
+ * A preview delivered by `renderProgressive`.
+ */
+export interface PreviewRenderResult extends BufferRenderResult {
+    /** Resolution of the preview. */
+    PPI: number,
+    /** Width in pixels. */
+    width: number,
+    /** Height in pixels. */
+    height: number,
+}
+
+export type RenderResult = FileRenderResult | BufferRenderResult | RawRenderResult
+
+/**
+ * Pixel layout of a `raw` render.
+ */
+export type RawColorMode = 'rgb' | 'rgba' | 'gray';
+
+/**
+ * Color mode of an encoded render: 8-bit RGB, 8-bit gray or 1-bit bilevel.
+ * `'mono'` works for `png` and `tiff` only.
+ */
+export type ColorMode = 'rgb' | 'gray' | 'mono';
 
 /**
  * Compression method for `tiff` format.
@@ -149,10 +235,168 @@ export interface RenderOptions {
      * Slice of a page to render instead of a full page.
      */
     slice?: Slice,
+    /**
+     * Pixel layout for `raw` format, or color mode of an encoded image (default `'rgb'`).
+     * Gray and bilevel pages render faster and encode smaller. Bilevel `tiff` is
+     * compressed with CCITT Group 4 unless `compression` says otherwise.
+     */
+    colorMode?: RawColorMode | ColorMode,
+    /**
+     * Paper color as `[r, g, b]` components from 0 to 255 (default white), or
+     * `'transparent'` to keep the page background see-through: `png` output then
+     * carries an alpha channel, and so do `raw` pixels in `'rgba'` color mode.
+     * Other formats and color modes don't support `'transparent'`.
+     */
+    background?: 'transparent' | [number, number, number],
+    /**
+     * Fails the render with an error whose `code` is `'ERR_RENDER_TIMEOUT'` if it
+     * doesn't finish within this many milliseconds. Time spent waiting for
+     * a worker thread counts too.
+     */
+    deadlineMs?: number,
+    /**
+     * Scheduling priority of an asynchronous render (default `'normal'`).
+     * Queued renders run highest priority first; a `'low'` render that has
+     * waited for a while is moved up to `'normal'`, so it still makes progress,
+     * while `'high'` renders always go first.
+     */
+    priority?: RenderPriority,
+    /**
+     * Whether a buffer render may be served from and stored in the render cache
+     * (default `true`). Has no effect until `setRenderCache` is called.
+     */
+    cache?: boolean,
+}
+
+export type RenderPriority = 'high' | 'normal' | 'low';
+
+/**
+ * Options for a `renderToFileAsync`/`renderToBufferAsync` operation.
+ */
+export interface AsyncRenderOptions extends RenderOptions {
+    /**
+     * Cancels the render. The promise rejects with an error whose `code`
+     * is `'ERR_RENDER_ABORTED'`.
+     */
+    signal?: AbortSignal,
+}
+
+/**
+ * Options for a `renderTiles` operation.
+ */
+export interface RenderTilesOptions extends AsyncRenderOptions {
+    /**
+     * Tiles to render, by column and row counted from the top left corner of the page.
+     */
+    tiles: { x: number, y: number }[],
+    /**
+     * Width and height of a tile in pixels (default 256).
+     */
+    tileSize?: number,
+    /**
+     * Not supported, tiles select the area to render.
+     */
+    slice?: never,
+}
+
+/**
+ * Options for a `renderProgressive` operation.
+ */
+export interface RenderProgressiveOptions extends AsyncRenderOptions {
+    /**
+     * Resolution of the preview (default 36).
+     */
+    previewPPI?: number,
+}
+
+/**
+ * Options for a `renderToWritable` or `renderToStream` operation.
+ */
+export interface RenderBandsOptions extends AsyncRenderOptions {
+    /**
+     * Rows rendered at once (default 256). Memory used for the bitmap is
+     * about `bandHeight` rows of the output image.
+     */
+    bandHeight?: number,
+    /**
+     * How long the render waits for the destination to take more output, in
+     * milliseconds, before it fails with an error whose `code` is
+     * `'ERR_RENDER_STALLED'` (default 60000, 0 for no limit). `deadlineMs`
+     * and `signal` also end the wait.
+     */
+    stallTimeoutMs?: number,
+}
+
+/**
+ * Options for a `renderPages` operation.
+ */
+export interface RenderPagesOptions {
+    /** Numbers of pages to render (default: all pages). */
+    pages?: number[],
+    /** Output format. */
+    method: 'png' | 'jpeg' | 'tiff',
+    /** Resolution in pixels per inch. */
+    PPI: number,
+    /** Render options applied to every page, `signal` aborts the whole batch. */
+    options?: AsyncRenderOptions,
+}
+
+/**
+ * Options for opening a document.
+ */
+export interface DocumentOptions {
+    /**
+     * Set to `false` to read pdf data straight from the given `Buffer` instead of
+     * copying it (default `true`). The document keeps a reference to the buffer,
+     * so its contents must not be changed while the document is alive. Not
+     * allowed for an `ArrayBuffer`, which could be detached.
+     */
+    copyBuffer?: boolean,
+    /**
+     * Set to `true` to map the document file into memory read-only instead of
+     * reading it through a `FILE*` stream (default `false`). Works only for documents
+     * opened by path. The file must not be truncated while the document is alive.
+     */
+    mmap?: boolean,
+    /**
+     * Memory budget in bytes for text layouts kept by `getWordList`, `findText` and
+     * `loadText` (default 32 MiB). Layouts are shared by all page objects of the
+     * document, per page and reading order; the least recently used go first.
+     */
+    textCacheSize?: number,
+    /**
+     * How long a fetch of a `DocumentSource` waits for `read` before the document
+     * data is taken as missing, in milliseconds (default 60000). A render also stops
+     * waiting once it is aborted or runs past its deadline.
+     */
+    readTimeoutMs?: number,
+}
+
+/**
+ * Document data read on demand, e.g. with HTTP range requests against object storage.
+ *
+ * Data is fetched in 8 KiB blocks and every block is kept while the document is alive.
+ * For a linearized document the first page can be shown after fetching only its blocks.
+ * Reads of one fetch are requested together, so `read` may be called concurrently.
+ */
+export interface DocumentSource {
+    /** Document size in bytes. */
+    size: number,
+    /**
+     * Returns `length` bytes of the document from `offset`.
+     * @param offset position in the document
+     * @param length number of bytes, never past `size`
+     */
+    read(offset: number, length: number): Promise<Buffer> | Buffer,
 }
 
 /**
  * PDF document.
+ *
+ * Asynchronous renders of one document run in parallel, up to `getConcurrency()`
+ * at a time. Each render thread works on its own copy of the document opened over
+ * the same file or buffer, so no locking is needed on your side. After `addAnnot`
+ * or `deleteAnnots` renders of the document see the change but run one at a time.
  */
 export class PopplerDocument {
     /** Is this document linearized? */
@@ -175,14 +419,81 @@ export class PopplerDocument {
      * @param fileName string | Buffer path to the document or a memory byffer containing pdf data.
      * @param userPassword string? password required to open this document, if any.
      * @param ownerPassword string? password required to manipulate this document, if any.
+     * @param options DocumentOptions? document options.
      */
-    constructor(fileName: string | Buffer, userPassword?: string, ownerPassword?: string);
+    constructor(
+        fileName: string | Buffer | ArrayBuffer,
+        userPassword?: string | null,
+        ownerPassword?: string | null,
+        options?: DocumentOptions,
+    );
+
+    /**
+     * Opens a PDF document on a worker thread so that parsing of a large or damaged
+     * document does not block the event loop. Rejects with the same errors
+     * the constructor throws.
+     *
+     * A document given as a `DocumentSource` can be opened only this way. Its data
+     * is fetched on worker threads, so use only asynchronous methods with it: get
+     * pages with `getPageAsync` and render them with the `*Async` and `render*`
+     * methods. Synchronous renders, text extraction and annotation changes throw.
+     * Its renders run one at a time and skip the render cache.
+     * @param fileName string | Buffer | DocumentSource path to the document, a memory byffer containing pdf data
+     * or a reader of the document data.
+     * @param userPassword string? password required to open this document, if any.
+     * @param ownerPassword string? password required to manipulate this document, if any.
+     * @param options DocumentOptions? document options.
+     */
+    static open(
+        fileName: string | Buffer | ArrayBuffer | DocumentSource,
+        userPassword?: string | null,
+        ownerPassword?: string | null,
+        options?: DocumentOptions,
+    ): Promise<PopplerDocument>;
+
+    /**
+     * Renders many pages of this document to buffers with a single native call.
+     * Pages are rendered in parallel on the render threads. Resolves to encoded
+     * images in order of `options.pages`; if pages fail, the error of the first
+     * of them in that order is reported. Pages of a document read through `read`
+     * must be loaded with `getPageAsync` first.
+     * @param options pages and render options
+     */
+    renderPages(options: RenderPagesOptions): Promise<Buffer[]>;
+
+    /** Text index of this document, once built or loaded. */
+    textIndex?: TextIndex
+
+    /**
+     * Extracts the words of all pages on worker threads into a `TextIndex`
+     * and keeps it as `textIndex`.
+     */
+    buildTextIndex(): Promise<TextIndex>;
+
+    /**
+     * Restores an index saved with `TextIndex#serialize()` as `textIndex`.
+     * @param data serialized index of this document
+     */
+    loadTextIndex(data: Buffer): TextIndex;
+
+    /**
+     * Searches `textIndex` for a word or phrase on all pages.
+     * @param query words to search
+     */
+    search(query: string): TextIndexHit[];
 
     /**
      * This method will return a specified page if it exists in the document.
      * @param number number of desired page.
      */
     getPage(number: number): PopplerPage | null;
+
+    /**
+     * Reads a page on a worker thread, then returns it like `getPage`. Use it with
+     * documents opened from a `DocumentSource`; rejects if the page can't be read.
+     * @param number number of desired page.
+     */
+    getPageAsync(number: number): Promise<PopplerPage | null>;
 }
 
 /**
@@ -267,9 +578,35 @@ export class PopplerPage {
         path: string,
         format: 'png' | 'jpeg' | 'tiff',
         ppi: number,
-        options?: RenderOptions,
+        options?: AsyncRenderOptions,
     ): Promise<FileRenderResult>;
 
+    /**
+     * Renders page to unencoded pixels syncronously.
+     * @param format `'raw'`
+     * @param ppi resolution in pixels per inch
+     * @param options render options
+     */
+    renderToBuffer(
+        format: 'raw',
+        ppi: number,
+        options?: RenderOptions,
+    ): RawRenderResult;
+
+    /**
+     * Renders page to unencoded pixels asyncronously using old-fashioned CPS API.
+     * @param format `'raw'`
+     * @param ppi resolution in pixels per inch
+     * @param options render options
+     * @param callback operation callback
+     */
+    renderToBuffer(
+        format: 'raw',
+        ppi: number,
+        options: RenderOptions,
+        callback: (err: Error, result: RawRenderResult) => any,
+    ): void;
+
     /**
      * Renders page to a buffer syncronously.
      * @param format output file format
@@ -308,6 +645,18 @@ export class PopplerPage {
         callback: (err: Error, result: BufferRenderResult) => any,
     ): void;
 
+    /**
+     * Renders page to unencoded pixels asyncronously. Returns `Promise`.
+     * @param format `'raw'`
+     * @param ppi resolution in pixels per inch
+     * @param options render options
+     */
+    renderToBufferAsync(
+        format: 'raw',
+        ppi: number,
+        options?: AsyncRenderOptions,
+    ): Promise<RawRenderResult>;
+
     /**
      * Renders page to a buffer asyncronously. Returns `Promise`.
      * @param format output file format
@@ -317,9 +666,118 @@ export class PopplerPage {
     renderToBufferAsync(
         format: 'png' | 'jpeg' | 'tiff',
         ppi: number,
-        options?: RenderOptions,
+        options?: AsyncRenderOptions,
     ): Promise<BufferRenderResult>;
 
+    /**
+     * Renders many tiles of this page at one resolution asyncronously, e.g. for
+     * a deep-zoom viewer. The page is rendered once for the area covered by
+     * the tiles, or once per tile when they lie far apart, and the tiles are
+     * encoded one by one and passed to `onTile` as soon as each is ready. Prefer it to one sliced `renderToBuffer` per tile.
+     * Returns `Promise` resolved after the last tile.
+     * @param format output file format
+     * @param ppi resolution in pixels per inch
+     * @param options tiles and render options
+     * @param onTile receives each tile
+     */
+    renderTiles(
+        format: 'png' | 'jpeg' | 'tiff',
+        ppi: number,
+        options: RenderTilesOptions,
+        onTile: (tile: TileRenderResult) => any,
+    ): Promise<void>;
+
+    /**
+     * Like `renderTiles` above, using old-fashioned CPS API.
+     * @param format output file format
+     * @param ppi resolution in pixels per inch
+     * @param options tiles and render options
+     * @param onTile receives each tile
+     * @param callback called after the last tile
+     */
+    renderTiles(
+        format: 'png' | 'jpeg' | 'tiff',
+        ppi: number,
+        options: RenderTilesOptions,
+        onTile: (tile: TileRenderResult) => any,
+        callback: (err: Error | null) => any,
+    ): void;
+
+    /**
+     * Renders page to a buffer asyncronously in two passes to cut first-paint
+     * latency. A quick preview at `previewPPI`, without vector antialiasing,
+     * is passed to `onPreview` first. The final image at `ppi` then reuses the
+     * page objects, resources and fonts loaded for the preview. Progressive renders
+     * don't use the render cache, so `onPreview` is always called. Returns `Promise`.
+     * @param format output file format
+     * @param ppi resolution in pixels per inch
+     * @param options render options
+     * @param onPreview receives the preview
+     */
+    renderProgressive(
+        format: 'png' | 'jpeg' | 'tiff',
+        ppi: number,
+        options: RenderProgressiveOptions,
+        onPreview: (preview: PreviewRenderResult) => any,
+    ): Promise<BufferRenderResult>;
+
+    /**
+     * Like `renderProgressive` above, using old-fashioned CPS API.
+     * @param format output file format
+     * @param ppi resolution in pixels per inch
+     * @param options render options
+     * @param onPreview receives the preview
+     * @param callback receives the final image
+     */
+    renderProgressive(
+        format: 'png' | 'jpeg' | 'tiff',
+        ppi: number,
+        options: RenderProgressiveOptions,
+        onPreview: (preview: PreviewRenderResult) => any,
+        callback: (err: Error | null, result: BufferRenderResult) => any,
+    ): void;
+
+    /**
+     * Renders page into a writable stream asyncronously, for pages too large to
+     * render at once. The page is rendered in horizontal bands. Each band is fed
+     * to the encoder and its output written to `writable` as it is produced.
+     * Rendering waits while the writable is busy, so memory use is bounded by the
+     * band height, not the page size. A waiting render still occupies a render
+     * thread, see `stallTimeoutMs`. `tiff` output is first written to a temporary
+     * file, because the encoder seeks back, or to memory where no temporary
+     * file can be created. `writable` isn't ended. Returns `Promise`
+     * resolved once all output has been handed to `writable`.
+     * @param writable destination, e.g. a file or HTTP response stream
+     * @param format output file format
+     * @param ppi resolution in pixels per inch
+     * @param options render options
+     */
+    renderToWritable(
+        writable: NodeJS.WritableStream,
+        format: 'png' | 'jpeg' | 'tiff',
+        ppi: number,
+        options?: RenderBandsOptions,
+    ): Promise<void>;
+
+    /**
+     * Renders page into a readable stream of encoded output. Rendering starts on
+     * the first read and is done in bands like `renderToWritable`. Chunks are
+     * emitted as the encoder produces them, so the first bytes are ready long
+     * before the image is complete. Rendering waits while the stream's buffer is
+     * full, and is aborted if the stream is destroyed. A stream left paused holds
+     * a render thread until `stallTimeoutMs` or `deadlineMs` passes, then errors
+     * with `'ERR_RENDER_STALLED'` or `'ERR_RENDER_TIMEOUT'`. Errors are emitted as
+     * `'error'` events.
+     * @param format output file format
+     * @param ppi resolution in pixels per inch
+     * @param options render options
+     */
+    renderToStream(
+        format: 'png' | 'jpeg' | 'tiff',
+        ppi: number,
+        options?: RenderBandsOptions,
+    ): NodeJS.ReadableStream;
+
     /**
      * This method tries to find `text` on this page.
      * @param text text to search
@@ -327,10 +785,57 @@ export class PopplerPage {
      */
     findText(text: string): RelRect[];
 
+    /**
+     * Searches for many texts in one pass over this page, ignoring case.
+     * @param texts texts to search
+     * @returns list of found rectangles for each of `texts`
+     */
+    findText(texts: string[]): RelRect[][];
+
+    /**
+     * Like `findText`, but lays out the text of the page on a worker thread.
+     * @param text text to search
+     * @returns list of found rectangles
+     */
+    findTextAsync(text: string): Promise<RelRect[]>;
+
+    /**
+     * Like `findText`, but lays out the text of the page on a worker thread.
+     * @param texts texts to search
+     * @returns list of found rectangles for each of `texts`
+     */
+    findTextAsync(texts: string[]): Promise<RelRect[][]>;
+
     /**
      * This method will return list of all words on this page.
+     * @param rawOrder keep words in content stream order
+     */
+    getWordList(rawOrder?: boolean | WordListOptions<'objects'>): Word[];
+
+    /**
+     * This method will return all words on this page packed into typed arrays.
+     * @param options word list options
+     */
+    getWordList(options: WordListOptions<'columnar'>): ColumnarWordList;
+
+    /**
+     * Like `getWordList`, but lays out the text of the page on a worker thread.
+     * @param rawOrder keep words in content stream order
      */
-    getWordList(): Word[];
+    getWordListAsync(rawOrder?: boolean | WordListOptions<'objects'>): Promise<Word[]>;
+
+    /**
+     * Like `getWordList`, but lays out the text of the page on a worker thread.
+     * @param options word list options
+     */
+    getWordListAsync(options: WordListOptions<'columnar'>): Promise<ColumnarWordList>;
+
+    /**
+     * Lays out the text of this page on a worker thread, so that following
+     * `findText` and `getWordList` calls return without blocking.
+     * @param rawOrder keep words in content stream order
+     */
+    loadText(rawOrder?: boolean): Promise<void>;
 
     /**
      * It's a way to "highlight" one or multiple rectangles on a page.
@@ -343,3 +848,95 @@ export class PopplerPage {
      */
     deleteAnnots(): void;
 }
+
+/**
+ * Occurrence of a word or phrase found by `TextIndex#search`.
+ */
+export interface TextIndexHit extends RelRect {
+    /** Page number. */
+    page: number,
+}
+
+/**
+ * In-memory inverted index of the words of a document.
+ *
+ * Matches whole words and phrases, ignoring case and punctuation
+ * around words. Unlike `findText` it doesn't find parts of words.
+ */
+export class TextIndex {
+    /** Number of pages of the indexed document. */
+    pageCount: number
+    /** Number of indexed words. */
+    wordCount: number
+
+    /**
+     * Restores a serialized index.
+     * @param data result of `serialize()`
+     */
+    constructor(data: Buffer);
+
+    /**
+     * Finds all occurrences of a word or phrase in document order.
+     * @param query words to search
+     */
+    search(query: string): TextIndexHit[];
+
+    /**
+     * Saves the index. The data uses the byte order of this machine.
+     */
+    serialize(): Buffer;
+}
+
+/**
+ * Sets the number of threads rendering pages (default: number of CPU cores).
+ * Renders run on their own threads, so `UV_THREADPOOL_SIZE` doesn't limit them
+ * and they don't hold up `fs`, `dns` or `zlib` work.
+ * @param concurrency positive integer
+ */
+export function setConcurrency(concurrency: number): void;
+
+/**
+ * Returns the number of threads rendering pages.
+ */
+export function getConcurrency(): number;
+
+export interface RenderCacheOptions {
+    /**
+     * Memory budget in bytes for encoded images (default 0).
+     */
+    maxBytes?: number,
+    /**
+     * Directory receiving images that don't fit in memory, one file each. Files
+     * are looked up on a memory miss, by this and other processes, and never
+     * deleted by the module.
+     */
+    spillDir?: string | null,
+}
+
+export interface RenderCacheStats {
+    /**
+     * Size of the images kept in memory.
+     */
+    bytes: number,
+    entries: number,
+    hits: number,
+    misses: number,
+}
+
+/**
+ * Turns on caching of encoded `png`, `jpeg` and `tiff` buffer renders, or
+ * changes its limits. Images are keyed by the document data, page, PPI, slice
+ * and format options, so a repeated render comes back without rendering, also
+ * for another document object opened from the same data. Renders of documents
+ * with added or deleted annotations are not cached, nor are those of documents
+ * opened with `copyBuffer: false` or `mmap: true`, whose data may still change.
+ * Call with `{}` to turn caching off.
+ */
+export function setRenderCache(options: RenderCacheOptions): void;
+
+/**
+ * Drops the images kept in memory. Spilled files are left in place.
+ */
+export function clearRenderCache(): void;
+
+export function getRenderCacheStats(): RenderCacheStats;
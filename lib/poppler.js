@@ -2,6 +2,7 @@
     'use strict';
     var Promise = require("bluebird");
     var existsSync = require("fs").existsSync;
+    var Readable = require("stream").Readable;
     
     var modulePath = existsSync(__dirname + '/../build/Release/poppler.node')
         ? '../build/Release/poppler'
@@ -17,6 +18,158 @@
     
     module.exports = require(modulePath);
 
+    var _open = module.exports.PopplerDocument.open;
+    module.exports.PopplerDocument.open = function () {
+        var self = this;
+        var args = Array.prototype.slice.call(arguments);
+        var source = args[0];
+        if (source && 'function' === typeof source.read && !Buffer.isBuffer(source)) {
+            // native reads take a callback, `source.read` may return a promise
+            args[0] = {
+                size: source.size,
+                read: function (offset, length, callback) {
+                    Promise.try(function () {
+                        return source.read(offset, length);
+                    }).then(function (data) {
+                        callback(null, data);
+                    }, function (err) {
+                        callback(err);
+                    });
+                }
+            };
+        }
+        if ('function' === typeof args[args.length - 1]) {
+            return _open.apply(self, args);
+        }
+        return new Promise(function (resolve, reject) {
+            args.push(function (err, result) {
+                if (err) {
+                    reject(err);
+                } else {
+                    resolve(result);
+                }
+            });
+            _open.apply(self, args);
+        });
+    };
+
+    var _renderPages = module.exports.PopplerDocument.prototype.renderPages;
+    module.exports.PopplerDocument.prototype.renderPages = function (options, callback) {
+        var self = this;
+        // the signal goes with the render options of every page
+        var renderOptions = [options && options.options];
+        var unbind = bindAbortSignal(renderOptions, 0);
+        if (renderOptions[0] !== (options && options.options)) {
+            options = Object.assign({}, options, { options: renderOptions[0] });
+        }
+        var run = function (cb) {
+            try {
+                _renderPages.call(self, options, function (err, result) {
+                    unbind();
+                    cb(err, result);
+                });
+            } catch (e) {
+                unbind();
+                throw e;
+            }
+        };
+        if ('function' === typeof callback) {
+            return run(callback);
+        }
+        return new Promise(function (resolve, reject) {
+            run(function (err, result) {
+                if (err) {
+                    reject(err);
+                } else {
+                    resolve(result);
+                }
+            });
+        });
+    };
+
+    var _buildTextIndex = module.exports.PopplerDocument.prototype.buildTextIndex;
+    module.exports.PopplerDocument.prototype.buildTextIndex = function (callback) {
+        var self = this;
+        var promise = new Promise(function (resolve, reject) {
+            _buildTextIndex.call(self, function (err, index) {
+                if (err) {
+                    reject(err);
+                } else {
+                    self.textIndex = index;
+                    resolve(index);
+                }
+            });
+        });
+        if ('function' === typeof callback) {
+            promise.then(function (index) {
+                callback(null, index);
+            }, callback);
+            return;
+        }
+        return promise;
+    };
+
+    module.exports.PopplerDocument.prototype.loadTextIndex = function (data) {
+        var index = new module.exports.TextIndex(data);
+        if (index.pageCount !== this.pageCount) {
+            throw new Error('Text index was built for another document');
+        }
+        this.textIndex = index;
+        return index;
+    };
+
+    module.exports.PopplerDocument.prototype.search = function (query) {
+        if (!this.textIndex) {
+            throw new Error('No text index. Call buildTextIndex() or loadTextIndex() first');
+        }
+        return this.textIndex.search(query);
+    };
+
+    var _loadText = module.exports.PopplerPage.prototype.loadText;
+    module.exports.PopplerPage.prototype.loadText = function () {
+        var self = this;
+        var args = Array.prototype.slice.call(arguments);
+        if ('function' === typeof args[args.length - 1]) {
+            return _loadText.apply(self, args);
+        }
+        return new Promise(function (resolve, reject) {
+            args.push(function (err) {
+                if (err) {
+                    reject(err);
+                } else {
+                    resolve();
+                }
+            });
+            _loadText.apply(self, args);
+        });
+    };
+
+    module.exports.PopplerPage.prototype.getWordListAsync = function (options) {
+        var self = this;
+        return new Promise(function (resolve, reject) {
+            self.getWordList(options || false, function (err, result) {
+                if (err) {
+                    reject(err);
+                } else {
+                    resolve(result);
+                }
+            });
+        });
+    };
+
+    module.exports.PopplerPage.prototype.findTextAsync = function (text) {
+        var self = this;
+        return new Promise(function (resolve, reject) {
+            self.findText(text, function (err, result) {
+                if (err) {
+                    reject(err);
+                } else {
+                    resolve(result);
+                }
+            });
+        });
+    };
+
     module.exports.PopplerDocument.prototype.getPage = function (num) {
         try {
             return new module.exports.PopplerPage(this, num);
@@ -29,6 +182,19 @@
         }
     };
 
+    module.exports.PopplerDocument.prototype.getPageAsync = function (num) {
+        var self = this;
+        return new Promise(function (resolve, reject) {
+            self.loadPage(num, function (err) {
+                if (err) {
+                    reject(err);
+                } else {
+                    resolve(self.getPage(num));
+                }
+            });
+        });
+    };
+
     if (module.exports.PopplerDocument.POPPLER_VERSION_MINOR < 23) {
         var _renderToFile = module.exports.PopplerPage.prototype.renderToFile;
         var _renderToBuffer = module.exports.PopplerPage.prototype.renderToBuffer;
@@ -68,6 +234,38 @@
         };
     }
 
+    /**
+     * Replaces an AbortSignal in render options (args[index]) with a flag
+     * the native renderer polls. Returns a function detaching the listener.
+     */
+    function bindAbortSignal(args, index) {
+        var options = args[index];
+        if (!options || typeof options !== 'object' || !options.signal) {
+            return function () {};
+        }
+        var signal = options.signal;
+        var flag = new Int32Array(1);
+        var copy = {};
+        Object.keys(options).forEach(function (key) {
+            if (key !== 'signal') {
+                copy[key] = options[key];
+            }
+        });
+        copy.abortFlag = flag;
+        args[index] = copy;
+        var onAbort = function () {
+            Atomics.store(flag, 0, 1);
+        };
+        if (signal.aborted) {
+            onAbort();
+            return function () {};
+        }
+        signal.addEventListener('abort', onAbort);
+        return function () {
+            signal.removeEventListener('abort', onAbort);
+        };
+    }
+
     module.exports.PopplerPage.prototype.renderToFileAsync = function () {
         var self = this;
         var args = Array.prototype.slice.call(arguments);
@@ -75,7 +273,9 @@
             if (typeof args[args.length - 1] === 'function') {
                 args.pop();
             }
+            var unbind = bindAbortSignal(args, 3);
             args.push(function (err, result) {
+                unbind();
                 if (err) {
                     reject(err);
                 } else {
@@ -93,7 +293,9 @@
             if (typeof args[args.length - 1] === 'function') {
                 args.pop();
             }
+            var unbind = bindAbortSignal(args, 2);
             args.push(function (err, result) {
+                unbind();
                 if (err) {
                     reject(err);
                 } else {
@@ -103,4 +305,150 @@
             self.renderToBuffer.apply(self, args);
         });
     };
+
+    var _renderTiles = module.exports.PopplerPage.prototype.renderTiles;
+    module.exports.PopplerPage.prototype.renderTiles = function (method, PPI, options, onTile, callback) {
+        var self = this;
+        if ('function' === typeof callback) {
+            return _renderTiles.call(self, method, PPI, options, onTile, callback);
+        }
+        return new Promise(function (resolve, reject) {
+            var args = [method, PPI, options];
+            var unbind = bindAbortSignal(args, 2);
+            _renderTiles.call(self, args[0], args[1], args[2], onTile, function (err) {
+                unbind();
+                if (err) {
+                    reject(err);
+                } else {
+                    resolve();
+                }
+            });
+        });
+    };
+
+    var _renderProgressive = module.exports.PopplerPage.prototype.renderProgressive;
+    module.exports.PopplerPage.prototype.renderProgressive = function (method, PPI, options, onPreview, callback) {
+        var self = this;
+        if ('function' === typeof callback) {
+            return _renderProgressive.call(self, method, PPI, options, onPreview, callback);
+        }
+        return new Promise(function (resolve, reject) {
+            var args = [method, PPI, options];
+            var unbind = bindAbortSignal(args, 2);
+            _renderProgressive.call(self, args[0], args[1], args[2], onPreview, function (err, result) {
+                unbind();
+                if (err) {
+                    reject(err);
+                } else {
+                    resolve(result);
+                }
+            });
+        });
+    };
+
+    /**
+     * Renders the page band by band into `writable`. The render thread waits
+     * while a few chunks are still being written, so neither the bitmap nor
+     * the encoded image is ever held in full.
+     */
+    module.exports.PopplerPage.prototype.renderToWritable = function (writable, method, PPI, options) {
+        var self = this;
+        var args = [method, PPI, options || {}];
+        return new Promise(function (resolve, reject) {
+            var unbind = bindAbortSignal(args, 2);
+            var opts = args[2];
+            if (!opts.abortFlag) {
+                opts = Object.assign({}, opts, { abortFlag: new Int32Array(1) });
+            }
+            var abortFlag = opts.abortFlag;
+            var failed = null;
+            // stop rendering if the destination goes away
+            var onError = function (err) {
+                failed = failed || err;
+                Atomics.store(abortFlag, 0, 1);
+            };
+            var onClose = function () {
+                onError(new Error('Destination closed before the image was written'));
+            };
+            writable.on('error', onError);
+            writable.on('close', onClose);
+            self.renderBands(args[0], args[1], opts, function (chunk, ack) {
+                writable.write(chunk, function () {
+                    ack();
+                });
+            }, function (err) {
+                unbind();
+                writable.removeListener('error', onError);
+                writable.removeListener('close', onClose);
+                if (failed || err) {
+                    reject(failed || err);
+                } else {
+                    resolve();
+                }
+            });
+        });
+    };
+
+    /**
+     * Renders the page band by band into a Readable. Rendering starts on the
+     * first read and waits while the stream's buffer is full.
+     */
+    module.exports.PopplerPage.prototype.renderToStream = function (method, PPI, options) {
+        var self = this;
+        var args = [method, PPI, options || {}];
+        var unbind = bindAbortSignal(args, 2);
+        var opts = args[2];
+        if (!opts.abortFlag) {
+            opts = Object.assign({}, opts, { abortFlag: new Int32Array(1) });
+        }
+        var abortFlag = opts.abortFlag;
+        // chunks pushed past the high water mark, acknowledged on the next read
+        var held = 0;
+        var ack = null;
+        var started = false;
+        var stream;
+        var start = function () {
+            self.renderBands(args[0], args[1], opts, function (chunk, chunkAck) {
+                ack = chunkAck;
+                if (stream.push(chunk)) {
+                    ack();
+                } else {
+                    held++;
+                }
+            }, function (err) {
+                unbind();
+                if (err) {
+                    stream.destroy(err);
+                } else {
+                    stream.push(null);
+                }
+            });
+        };
+        stream = new Readable({
+            read: function () {
+                if (held > 0) {
+                    ack(held);
+                    held = 0;
+                }
+                if (!started) {
+                    started = true;
+                    try {
+                        start();
+                    } catch (e) {
+                        unbind();
+                        stream.destroy(e);
+                    }
+                }
+            },
+            destroy: function (err, callback) {
+                // stops a render nobody reads anymore, waking it if it waits for room
+                Atomics.store(abortFlag, 0, 1);
+                if (ack) {
+                    ack(0);
+                }
+                callback(err);
+            }
+        });
+        return stream;
+    };
 })();
@@ -0,0 +1,88 @@
+#include <deque>
+#include "AhoCorasick.h"
+
+AhoCorasick::AhoCorasick()
+{
+    nodes.push_back(Node{ROOT, -1, std::vector<size_t>()});
+}
+
+size_t AhoCorasick::add(const uint32_t *pattern, size_t length)
+{
+    size_t id = lengths.size();
+    lengths.push_back(length);
+    if (length == 0)
+        return id;
+
+    int state = ROOT;
+    for (size_t i = 0; i < length; i++)
+    {
+        int to = next(state, pattern[i]);
+        if (to == -1)
+        {
+            to = nodes.size();
+            nodes.push_back(Node{ROOT, -1, std::vector<size_t>()});
+            edges[((uint64_t)state << 32) | pattern[i]] = to;
+        }
+        state = to;
+    }
+    nodes[state].patterns.push_back(id);
+    return id;
+}
+
+int AhoCorasick::next(int state, uint32_t c) const
+{
+    auto it = edges.find(((uint64_t)state << 32) | c);
+    return it == edges.end() ? -1 : it->second;
+}
+
+void AhoCorasick::build()
+{
+    // children of a node, collected once so links are set in breadth-first order
+    std::vector<std::vector<std::pair<uint32_t, int>>> children(nodes.size());
+    for (auto &edge : edges)
+    {
+        children[edge.first >> 32].push_back(std::make_pair((uint32_t)edge.first, edge.second));
+    }
+
+    std::deque<int> queue;
+    for (auto &child : children[ROOT])
+    {
+        nodes[child.second].fail = ROOT;
+        queue.push_back(child.second);
+    }
+    while (!queue.empty())
+    {
+        int state = queue.front();
+        queue.pop_front();
+        for (auto &child : children[state])
+        {
+            int fail = nodes[state].fail;
+            int to;
+            while ((to = next(fail, child.first)) == -1 && fail != ROOT)
+                fail = nodes[fail].fail;
+            Node &node = nodes[child.second];
+            node.fail = to != -1 ? to : ROOT;
+            node.output = nodes[node.fail].patterns.empty() ? nodes[node.fail].output : node.fail;
+            queue.push_back(child.second);
+        }
+    }
+}
+
+int AhoCorasick::step(int state, uint32_t c) const
+{
+    int to;
+    while ((to = next(state, c)) == -1 && state != ROOT)
+        state = nodes[state].fail;
+    return to != -1 ? to : ROOT;
+}
+
+void AhoCorasick::matches(int state, std::vector<size_t> &out) const
+{
+    if (nodes[state].patterns.empty())
+        state = nodes[state].output;
+    while (state != -1)
+    {
+        out.insert(out.end(), nodes[state].patterns.begin(), nodes[state].patterns.end());
+        state = nodes[state].output;
+    }
+}
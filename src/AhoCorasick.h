@@ -0,0 +1,58 @@
+#ifndef __AHO_CORASICK
+#define __AHO_CORASICK
+#include <stddef.h>
+#include <stdint.h>
+#include <unordered_map>
+#include <vector>
+
+/**
+ * Aho-Corasick automaton finding any number of code point patterns
+ * in one pass over a text.
+ */
+class AhoCorasick
+{
+public:
+    AhoCorasick();
+
+    /**
+     * Adds a pattern and returns its number. Empty patterns never match.
+     */
+    size_t add(const uint32_t *pattern, size_t length);
+
+    /**
+     * Computes failure links. Call once after all patterns are added.
+     */
+    void build();
+
+    /**
+     * Feeds one code point. \return state to pass to the next call and matches()
+     */
+    int step(int state, uint32_t c) const;
+
+    /**
+     * Appends numbers of the patterns ending at `state`.
+     */
+    void matches(int state, std::vector<size_t> &out) const;
+
+    size_t patternLength(size_t pattern) const { return lengths[pattern]; }
+
+    static const int ROOT = 0;
+
+private:
+    struct Node
+    {
+        int fail;
+        // nearest node on the failure chain that ends a pattern, or -1
+        int output;
+        // patterns ending exactly here
+        std::vector<size_t> patterns;
+    };
+
+    int next(int state, uint32_t c) const;
+
+    std::vector<Node> nodes;
+    // (node << 32 | code point) -> node
+    std::unordered_map<uint64_t, int> edges;
+    std::vector<size_t> lengths;
+};
+#endif
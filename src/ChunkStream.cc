@@ -0,0 +1,131 @@
+#include <chrono>
+
+#include "ChunkStream.h"
+
+inline SSIZE_TYPE chunk_stream_write(void *cookie, const char *buf, SIZE_TYPE size) {
+    return ((ChunkStream*) cookie)->write(buf, size);
+}
+
+inline int chunk_stream_close(void *cookie) {
+    return ((ChunkStream*) cookie)->close();
+}
+
+FILE* ChunkStream::open() {
+#ifdef __linux
+    cookie_io_functions_t funcs = {NULL, chunk_stream_write, NULL, chunk_stream_close};
+    FILE* f = fopencookie((void*) this, "wb", funcs);
+#elif __APPLE__
+    FILE* f = funopen((void*) this, NULL, chunk_stream_write, NULL, chunk_stream_close);
+#endif
+    // chunks are collected here, stdio buffering would only add a copy
+    if (f != NULL) {
+        setvbuf(f, NULL, _IONBF, 0);
+    }
+    return f;
+}
+
+bool ChunkStream::copyFrom(FILE *in) {
+    char buf[CHUNK_SIZE];
+    size_t n;
+    while ((n = fread(buf, 1, sizeof(buf), in)) > 0) {
+        if (write(buf, n) != (SSIZE_TYPE) n) {
+            return false;
+        }
+    }
+    return !ferror(in);
+}
+
+SSIZE_TYPE ChunkStream::write(const char *buf, SIZE_TYPE size) {
+    SIZE_TYPE written = 0;
+    while (!failed && written < size) {
+        if (chunk == NULL) {
+            chunk = (char*) malloc(CHUNK_SIZE);
+            if (chunk == NULL) {
+                failed = true;
+                break;
+            }
+        }
+        size_t n = CHUNK_SIZE - length;
+        if (n > (size_t) (size - written)) {
+            n = size - written;
+        }
+        memcpy(chunk + length, buf + written, n);
+        length += n;
+        written += n;
+        if (length == CHUNK_SIZE && !post()) {
+            break;
+        }
+    }
+    return failed ? -1 : written;
+}
+
+int ChunkStream::close() {
+    if (!failed && length > 0) {
+        post();
+    }
+    return failed ? -1 : 0;
+}
+
+/**
+ * Posts the current chunk once the consumer has room for it.
+ */
+bool ChunkStream::post() {
+    {
+        std::unique_lock<std::mutex> guard(window->lock);
+        auto giveUp = std::chrono::steady_clock::now() + std::chrono::milliseconds(stallTimeoutMs);
+        while (posted - window->consumed >= WINDOW) {
+            // wake up now and then to check the render's abort flag and deadline
+            if (shouldAbort()) {
+                failed = true;
+                return false;
+            }
+            if (stallTimeoutMs > 0 && std::chrono::steady_clock::now() >= giveUp) {
+                failed = stalled = true;
+                return false;
+            }
+            window->room.wait_for(guard, std::chrono::milliseconds(50));
+        }
+    }
+    char *data = chunk;
+    size_t len = length;
+    DeliverCb cb = deliver;
+    queue->post([cb, data, len]() {
+        cb(data, len);
+    });
+    chunk = NULL;
+    length = 0;
+    posted++;
+    return true;
+}
+
+v8::Local<v8::Function> ChunkStream::ackFunction(std::shared_ptr<Window> window) {
+    Nan::EscapableHandleScope scope;
+    Ack *ack = new Ack();
+    ack->window = window;
+    v8::Local<v8::Function> fn = Nan::GetFunction(
+        Nan::New<v8::FunctionTemplate>(onAck, Nan::New<v8::External>(ack))).ToLocalChecked();
+    ack->fn.Reset(fn);
+    ack->fn.SetWeak(ack, onCollected, Nan::WeakCallbackType::kParameter);
+    return scope.Escape(fn);
+}
+
+/**
+ * JS: ack(count = 1). ack(0) only wakes the writing thread, e.g. to have
+ * it notice the render was aborted.
+ */
+NAN_METHOD(ChunkStream::onAck) {
+    Ack *ack = static_cast<Ack*>(info.Data().As<v8::External>()->Value());
+    int32_t count = info.Length() > 0 && info[0]->IsInt32() ? Nan::To<int32_t>(info[0]).FromJust() : 1;
+    if (count < 0) {
+        return;
+    }
+    std::lock_guard<std::mutex> guard(ack->window->lock);
+    ack->window->consumed += count;
+    ack->window->room.notify_all();
+}
+
+void ChunkStream::onCollected(const Nan::WeakCallbackInfo<Ack> &info) {
+    Ack *ack = info.GetParameter();
+    ack->fn.Reset();
+    delete ack;
+}
@@ -0,0 +1,108 @@
+#ifndef __CHUNK_STREAM
+#define __CHUNK_STREAM
+#include <stdio.h>
+#include <stdint.h>
+#include <condition_variable>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <nan.h>
+
+#include "MemoryStream.h"
+#include "ProgressQueue.h"
+
+/**
+ * Write-only FILE handing encoder output to the main thread in chunks
+ * while a render runs, so the encoded image is never held in full.
+ *
+ * Output is cut into CHUNK_SIZE chunks, each posted through a ProgressQueue
+ * to `deliver`, which takes over the malloc'ed data. JS tells which chunks
+ * it is done with by calling the function made by ackFunction(); once WINDOW
+ * chunks are posted and not yet acknowledged, the writing thread sleeps on
+ * the window, until more are acknowledged, `shouldAbort` tells it to give up
+ * or nothing was acknowledged for the stall timeout. The stream then fails
+ * and the encoder with it.
+ */
+class ChunkStream
+{
+public:
+    static const size_t CHUNK_SIZE = 65536;
+    static const int32_t WINDOW = 8;
+
+    typedef std::function<void(char *data, size_t len)> DeliverCb;
+    typedef std::function<bool()> AbortCb;
+
+    /**
+     * Count of acknowledged chunks, shared with the JS function acknowledging
+     * them, which may outlive the stream.
+     */
+    struct Window {
+        Window() : consumed(0) {};
+
+        std::mutex lock;
+        std::condition_variable room;
+        int32_t consumed;
+    };
+
+    /**
+     * Makes a JS function `ack(count = 1)` acknowledging chunks of `window`;
+     * `ack(0)` just wakes the writing thread. Must be called from the main thread.
+     */
+    static v8::Local<v8::Function> ackFunction(std::shared_ptr<Window> window);
+
+    /**
+     * \param stallTimeoutMs how long to wait for an acknowledgement, 0 for no limit
+     */
+    ChunkStream(ProgressQueue *queue, DeliverCb deliver, std::shared_ptr<Window> window, AbortCb shouldAbort,
+                unsigned int stallTimeoutMs)
+        : queue(queue), deliver(deliver), window(window), shouldAbort(shouldAbort),
+          stallTimeoutMs(stallTimeoutMs), chunk(NULL), length(0), posted(0), failed(false), stalled(false) {};
+
+    ~ChunkStream() {
+        free(chunk);
+    };
+
+    FILE* open();
+
+    /**
+     * Sends the rest of `in`, e.g. a temporary file written by a seeking encoder.
+     */
+    bool copyFrom(FILE *in);
+
+    /**
+     * Tells whether output was dropped because the render was cancelled
+     * or memory ran out.
+     */
+    bool hasFailed() { return failed; };
+
+    /**
+     * Tells whether output was dropped because JS stopped acknowledging chunks.
+     */
+    bool hasStalled() { return stalled; };
+
+    SSIZE_TYPE write(const char *buf, SIZE_TYPE size);
+    int close();
+
+private:
+    // JS function of ackFunction(), freed once it is garbage collected
+    struct Ack {
+        std::shared_ptr<Window> window;
+        Nan::Persistent<v8::Function> fn;
+    };
+
+    bool post();
+    static NAN_METHOD(onAck);
+    static void onCollected(const Nan::WeakCallbackInfo<Ack> &info);
+
+    ProgressQueue *queue;
+    DeliverCb deliver;
+    std::shared_ptr<Window> window;
+    AbortCb shouldAbort;
+    unsigned int stallTimeoutMs;
+    char *chunk;
+    size_t length;
+    int32_t posted;
+    bool failed;
+    bool stalled;
+};
+#endif
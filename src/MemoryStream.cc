@@ -11,44 +11,117 @@ inline OFFSET_TYPE pow2roundup(OFFSET_TYPE x) {
     return x+1;
 }
 
+inline SSIZE_TYPE memory_stream_read(void *cookie, char *buf, SIZE_TYPE size) {
+    return ((Cookie*) cookie)->read(buf, size);
+}
+
 inline SSIZE_TYPE memory_stream_write(void *cookie, const char *buf, SIZE_TYPE size) {
     return ((Cookie*) cookie)->write(buf, size);
 }
 
+#ifdef __linux
+inline SEEK_RETURN_TYPE memory_stream_seek(void *cookie, OFFSET_TYPE *offset, int whence) {
+    OFFSET_TYPE pos = ((Cookie*) cookie)->seek(*offset, whence);
+    if (pos == -1) {
+        return -1;
+    }
+    *offset = pos;
+    return 0;
+}
+#elif __APPLE__
+inline SEEK_RETURN_TYPE memory_stream_seek(void *cookie, OFFSET_TYPE offset, int whence) {
+    return ((Cookie*) cookie)->seek(offset, whence);
+}
+#endif
+
 inline int memory_stream_close(void *cookie) {
     return ((Cookie*) cookie)->close();
 }
 
+inline SSIZE_TYPE Cookie::read(char *buf, SIZE_TYPE size) {
+    return stream->read(buf, size);
+}
+
 inline SSIZE_TYPE Cookie::write(const char *buf, SIZE_TYPE size) {
     return stream->write(buf, size);
 }
 
+inline OFFSET_TYPE Cookie::seek(OFFSET_TYPE offset, int whence) {
+    return stream->seek(offset, whence);
+}
+
 inline int Cookie::close() {
     return stream->close();
 }
 
 FILE* MemoryStream::open() {
 #ifdef __linux
-    cookie_io_functions_t funcs = {NULL, memory_stream_write, NULL, memory_stream_close};
-    return fopencookie((void*) cookie, "wb", funcs);
+    cookie_io_functions_t funcs = {memory_stream_read, memory_stream_write, memory_stream_seek, memory_stream_close};
+    FILE* f = fopencookie((void*) cookie, "w+b", funcs);
 #elif __APPLE__
-    return funopen((void*) cookie, NULL, memory_stream_write, NULL, memory_stream_close);
+    FILE* f = funopen((void*) cookie, memory_stream_read, memory_stream_write, memory_stream_seek, memory_stream_close);
 #endif
+    // Encoders write whole chunks, so stdio buffering would only add a copy
+    if (f != NULL) {
+        setvbuf(f, NULL, _IONBF, 0);
+    }
+    return f;
 }
 
 SSIZE_TYPE MemoryStream::write(const char *buf, SIZE_TYPE size) {
     if (((OFFSET_TYPE)(offset + size)) > buffer_len) {
-        buffer_len = pow2roundup(offset + size);
-        buffer = (char*) realloc(buffer, buffer_len);
+        OFFSET_TYPE new_len = pow2roundup(offset + size);
+        char* new_buffer = (char*) realloc(buffer, new_len);
+        if (! new_buffer) {
+            return 0;
+        }
+        buffer = new_buffer;
+        buffer_len = new_len;
     }
-    if (! buffer) {
-        return 0;
+    if (offset > length) {
+        // writing after a seek past the end leaves a zero-filled gap
+        memset(buffer + length, 0, offset - length);
     }
     memcpy(buffer + offset, buf, size);
     offset += size;
+    if (offset > length) {
+        length = offset;
+    }
+    return size;
+}
+
+SSIZE_TYPE MemoryStream::read(char *buf, SIZE_TYPE size) {
+    if (offset >= length) {
+        return 0;
+    }
+    if ((OFFSET_TYPE)(offset + size) > length) {
+        size = length - offset;
+    }
+    memcpy(buf, buffer + offset, size);
+    offset += size;
     return size;
 }
 
+OFFSET_TYPE MemoryStream::seek(OFFSET_TYPE pos, int whence) {
+    switch (whence) {
+    case SEEK_SET:
+        break;
+    case SEEK_CUR:
+        pos += offset;
+        break;
+    case SEEK_END:
+        pos += length;
+        break;
+    default:
+        return -1;
+    }
+    if (pos < 0) {
+        return -1;
+    }
+    offset = pos;
+    return offset;
+}
+
 int MemoryStream::close() {
     return 0;
 }
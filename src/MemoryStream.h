@@ -1,4 +1,5 @@
 #ifndef __MEMORY_STREAM
+#define __MEMORY_STREAM
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -26,7 +27,9 @@ public:
 
     MemoryStream* getStream() { return stream; };
 
+    SSIZE_TYPE read(char *buf, SIZE_TYPE size);
     SSIZE_TYPE write(const char *buf, SIZE_TYPE size);
+    OFFSET_TYPE seek(OFFSET_TYPE offset, int whence);
     int close();
 
 private:
@@ -36,28 +39,59 @@ private:
 class MemoryStream
 {
 public:
-    MemoryStream() : buffer_given(false), offset(0), buffer(NULL), buffer_len(0) {
+    /**
+     * `capacity` is the expected output size. Storage of that size is reserved
+     * up front so the stream does not have to grow while an image is encoded.
+     */
+    MemoryStream(size_t capacity = 0) : buffer_given(false), offset(0), length(0), buffer(NULL), buffer_len(0) {
         cookie = new Cookie(this);
+        if (capacity > 0) {
+            buffer = (char*) malloc(capacity);
+            buffer_len = buffer != NULL ? capacity : 0;
+        }
     };
 
     ~MemoryStream() {
-        if (buffer != NULL && !buffer_given) delete buffer;
+        if (buffer != NULL && !buffer_given) free(buffer);
         delete cookie;
     };
 
+    /**
+     * Opens a seekable read/write stream, so it also suits writers
+     * that go back to patch headers (e.g. libtiff).
+     */
     FILE* open();
-    OFFSET_TYPE getBufferLen() { return offset; };
+    OFFSET_TYPE getBufferLen() { return length; };
+    /**
+     * Data written so far, still owned by the stream. Flush the FILE first.
+     */
+    const char* getBuffer() { return buffer; };
+    /**
+     * Hands the malloc'ed buffer over to the caller, trimmed to the written length.
+     */
     char* giveBuffer() {
         buffer_given = true;
+        if (buffer != NULL && length > 0 && length < buffer_len) {
+            char* trimmed = (char*) realloc(buffer, length);
+            if (trimmed != NULL) {
+                buffer = trimmed;
+                buffer_len = length;
+            }
+        }
         return buffer;
     }
 
+    SSIZE_TYPE read(char *buf, SIZE_TYPE size);
     SSIZE_TYPE write(const char *buf, SIZE_TYPE size);
+    OFFSET_TYPE seek(OFFSET_TYPE offset, int whence);
     int close();
 
 private:
     bool buffer_given;
+    // current position
     OFFSET_TYPE offset;
+    // amount of data written
+    OFFSET_TYPE length;
     char* buffer;
     OFFSET_TYPE buffer_len;
     Cookie* cookie;
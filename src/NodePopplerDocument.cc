@@ -1,22 +1,25 @@
 #include <v8.h>
 #include <node.h>
 #include <node_buffer.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <algorithm>
+#include <atomic>
 
 #include "NodePopplerDocument.h"
+#include "RenderPool.h"
 #include "NodePopplerPage.h"
+#include "NodeTextIndex.h"
 
-std::unique_ptr<PDFDoc> createMemPDFDoc(
-    char *buffer,
-    size_t length,
+std::unique_ptr<PDFDoc> createStreamPDFDoc(
+    BaseStream *stream,
     GooString* ownerPassword = nullptr,
     GooString* userPassword = nullptr)
 {
-    Object obj;
-
-#if ((POPPLER_VERSION_MAJOR == 0) && (POPPLER_VERSION_MINOR <= 57))
-    obj.initNull();
-    std::unique_ptr<PDFDoc> doc(new PDFDoc(new MemStream(buffer, 0, length, &obj), ownerPassword, userPassword));
-#elif ((POPPLER_VERSION_MAJOR == 22) && (POPPLER_VERSION_MINOR >= 3)) || POPPLER_VERSION_MAJOR > 22
+#if ((POPPLER_VERSION_MAJOR == 22) && (POPPLER_VERSION_MINOR >= 3)) || POPPLER_VERSION_MAJOR > 22
     std::optional<GooString> ownerPW, userPW;
     if (ownerPassword != nullptr)
     {
@@ -26,19 +29,174 @@ std::unique_ptr<PDFDoc> createMemPDFDoc(
     {
         userPW = GooString(userPassword);
     }
-    std::unique_ptr<PDFDoc> doc(new PDFDoc(new MemStream(buffer, 0, length, std::move(obj)), ownerPW, userPW));
+    std::unique_ptr<PDFDoc> doc(new PDFDoc(stream, ownerPW, userPW));
 #else
-    std::unique_ptr<PDFDoc> doc(new PDFDoc(new MemStream(buffer, 0, length, std::move(obj)), ownerPassword, userPassword));
+    std::unique_ptr<PDFDoc> doc(new PDFDoc(stream, ownerPassword, userPassword));
 #endif
     return doc;
 }
 
+std::unique_ptr<PDFDoc> createMemPDFDoc(
+    char *buffer,
+    size_t length,
+    GooString* ownerPassword = nullptr,
+    GooString* userPassword = nullptr)
+{
+    Object obj;
+
+#if ((POPPLER_VERSION_MAJOR == 0) && (POPPLER_VERSION_MINOR <= 57))
+    obj.initNull();
+    return createStreamPDFDoc(new MemStream(buffer, 0, length, &obj), ownerPassword, userPassword);
+#else
+    return createStreamPDFDoc(new MemStream(buffer, 0, length, std::move(obj)), ownerPassword, userPassword);
+#endif
+}
+
+std::unique_ptr<PDFDoc> createCachedPDFDoc(
+    CachedFileLoader *loader,
+    GooString* ownerPassword = nullptr,
+    GooString* userPassword = nullptr)
+{
+    Object obj;
+
+    // CachedFile owns the loader and the stream holds the only reference to the file
+#if POPPLER_VERSION_MAJOR < 21
+    CachedFile *file = new CachedFile(loader, new GooString());
+#else
+    CachedFile *file = new CachedFile(loader);
+#endif
+#if ((POPPLER_VERSION_MAJOR == 0) && (POPPLER_VERSION_MINOR <= 57))
+    obj.initNull();
+    return createStreamPDFDoc(new CachedFileStream(file, 0, false, file->getLength(), &obj), ownerPassword, userPassword);
+#else
+    return createStreamPDFDoc(new CachedFileStream(file, 0, false, file->getLength(), std::move(obj)), ownerPassword, userPassword);
+#endif
+}
+
+#define THROW_ASYNC_ERR(work, err)           \
+    {                                        \
+        Local<Value> argv[] = {err};         \
+        Nan::TryCatch try_catch;             \
+        Nan::Call(*work->callback, 1, argv); \
+        if (try_catch.HasCaught())           \
+        {                                    \
+            Nan::FatalException(try_catch);  \
+        }                                    \
+        delete work;                         \
+        return;                              \
+    }
+
 using namespace v8;
 using namespace node;
 using Nan::To;
 
+namespace
+{
+/**
+ * State of a single renderPages call: one RenderWork and one render pool
+ * task per requested page, so pages render in parallel and keep their
+ * priority against other renders.
+ */
+class BatchRenderWork
+{
+  public:
+    BatchRenderWork() : callback(NULL), error(NULL), errorCode(NULL), finished(0), failed(false)
+    {
+    }
+    ~BatchRenderWork()
+    {
+        for (NodePopplerPage::RenderWork *w : works)
+            delete w;
+        for (NodePopplerPage *p : pages)
+            delete p;
+        if (error)
+            delete[] error;
+        if (callback != NULL)
+            delete callback;
+        docHandle.Reset();
+    }
+
+    // one per page, each with the index of its page in `works`
+    std::vector<uv_work_t> requests;
+    Nan::Callback *callback;
+    char *error;
+    const char *errorCode;
+    // tasks whose after callback ran, main thread only
+    size_t finished;
+    // set once a page fails, the pages not started yet are skipped
+    std::atomic<bool> failed;
+    std::vector<NodePopplerPage *> pages;
+    std::vector<NodePopplerPage::RenderWork *> works;
+    // keeps the document alive while its pages are rendered
+    Nan::Persistent<v8::Object> docHandle;
+};
+
+/**
+ * State of a buildTextIndex call. Pages are laid out by several render
+ * threads, each taking the next page from a shared counter.
+ */
+class TextIndexWork
+{
+  public:
+    TextIndexWork(size_t tasks, int pageCount)
+        : callback(NULL), requests(tasks), running(tasks), finished(0), nextPage(0),
+          pages(pageCount), index(NULL), doc(NULL)
+    {
+        for (uv_work_t &request : requests)
+            request.data = this;
+    }
+    ~TextIndexWork()
+    {
+        if (callback != NULL)
+            delete callback;
+        if (index != NULL)
+            delete index;
+        docHandle.Reset();
+    }
+
+    Nan::Callback *callback;
+    std::vector<uv_work_t> requests;
+    // tasks still working, the last one builds the index
+    std::atomic<size_t> running;
+    // tasks whose after callback ran, main thread only
+    size_t finished;
+    std::atomic<int> nextPage;
+    std::vector<std::vector<NodePopplerPage::TextBox>> pages;
+    TextIndex *index;
+    node::NodePopplerDocument *doc;
+    // keeps the document alive while its pages are laid out
+    Nan::Persistent<v8::Object> docHandle;
+};
+
+class LoadPageWork
+{
+  public:
+    LoadPageWork()
+        : callback(NULL), pageNum(0), inBounds(false), page(NULL), doc(NULL)
+    {
+        request.data = this;
+    }
+    ~LoadPageWork()
+    {
+        if (callback != NULL)
+            delete callback;
+        docHandle.Reset();
+    }
+
+    uv_work_t request;
+    Nan::Callback *callback;
+    int pageNum;
+    bool inBounds;
+    Page *page;
+    node::NodePopplerDocument *doc;
+    Nan::Persistent<v8::Object> docHandle;
+};
+}
+
 namespace node
 {
+Nan::Persistent<v8::Function> NodePopplerDocument::constructor;
+
 void NodePopplerDocument::evPageOpened(NodePopplerPage *p)
 {
     for (NodePopplerPage* kp : pages) {
@@ -61,11 +219,54 @@ void NodePopplerDocument::evPageClosed(NodePopplerPage *p)
 
 NodePopplerDocument::NodePopplerDocument(
     const char *cFileName,
+    bool map,
     GooString* ownerPassword,
     GooString* userPassword)
+    : mapping(NULL), mappingLength(0), mapErrno(0), linearized(false)
 {
     doc = NULL;
     buffer = NULL;
+    pages = std::vector<NodePopplerPage*>();
+
+    if (map)
+    {
+        // Serve all reads from a read-only shared mapping of the file
+        // instead of a FILE* based stream.
+        const char *path = cFileName;
+        if (strncmp(path, "file://", 7) == 0)
+        {
+            path += 7;
+        }
+        int fd = ::open(path, O_RDONLY);
+        if (fd == -1)
+        {
+            mapErrno = errno;
+            return;
+        }
+        struct stat st;
+        if (fstat(fd, &st) == -1)
+        {
+            mapErrno = errno;
+            close(fd);
+            return;
+        }
+        if (st.st_size > 0)
+        {
+            mapping = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+            if (mapping == MAP_FAILED)
+            {
+                mapErrno = errno;
+                mapping = NULL;
+                close(fd);
+                return;
+            }
+            mappingLength = st.st_size;
+        }
+        close(fd);
+        mappedFileName = path;
+        doc = createMemPDFDoc((char *)(mapping ? mapping : ""), mappingLength, ownerPassword, userPassword);
+        return;
+    }
 
     GooString *fileNameA = new GooString(cFileName);
 
@@ -85,21 +286,36 @@ NodePopplerDocument::NodePopplerDocument(
 #else
     doc = PDFDocFactory().createPDFDoc(*fileNameA, ownerPassword, userPassword);
 #endif
-
-    pages = std::vector<NodePopplerPage*>();
 }
 
 NodePopplerDocument::NodePopplerDocument(
     char *buffer,
     size_t length,
+    bool copy,
     GooString* ownerPassword,
     GooString* userPassword)
+    : mapping(NULL), mappingLength(0), mapErrno(0), linearized(false)
 {
     doc = NULL;
     this->buffer = NULL;
-    this->buffer = new char[length];
-    std::memcpy(this->buffer, buffer, length);
-    doc = createMemPDFDoc(this->buffer, length, ownerPassword, userPassword);
+    if (copy)
+    {
+        this->buffer = new char[length];
+        std::memcpy(this->buffer, buffer, length);
+        buffer = this->buffer;
+    }
+    doc = createMemPDFDoc(buffer, length, ownerPassword, userPassword);
+    pages = std::vector<NodePopplerPage*>();
+}
+
+NodePopplerDocument::NodePopplerDocument(
+    CachedFileLoader *loader,
+    GooString* ownerPassword,
+    GooString* userPassword)
+    : mapping(NULL), mappingLength(0), mapErrno(0), linearized(false)
+{
+    buffer = NULL;
+    doc = createCachedPDFDoc(loader, ownerPassword, userPassword);
     pages = std::vector<NodePopplerPage*>();
 }
 
@@ -109,8 +325,16 @@ NodePopplerDocument::~NodePopplerDocument()
         p->evDocumentClosed();
     }
 
+    // Output devices refer to the PDFDoc, and MemStream must go away
+    // before the memory it points to
+    renderContexts.reset();
+    textLayouts.reset();
+    doc.reset();
     if (buffer)
-        delete buffer;
+        delete[] buffer;
+    source.Reset();
+    if (mapping)
+        munmap(mapping, mappingLength);
 }
 
 NAN_MODULE_INIT(NodePopplerDocument::Init)
@@ -145,9 +369,15 @@ NAN_MODULE_INIT(NodePopplerDocument::Init)
                      Nan::New<String>("fileName").ToLocalChecked(),
                      NodePopplerDocument::paramsGetter);
 
+    Nan::SetMethod(tpl, "open", NodePopplerDocument::open);
+    Nan::SetPrototypeMethod(tpl, "renderPages", NodePopplerDocument::renderPages);
+    Nan::SetPrototypeMethod(tpl, "buildTextIndex", NodePopplerDocument::buildTextIndex);
+    Nan::SetPrototypeMethod(tpl, "loadPage", NodePopplerDocument::loadPage);
+
+    constructor.Reset(Nan::GetFunction(tpl).ToLocalChecked());
     Nan::Set(target,
         Nan::New<String>("PopplerDocument").ToLocalChecked(),
-        Nan::GetFunction(tpl).ToLocalChecked());
+        Nan::New(constructor));
 }
 
 NAN_GETTER(NodePopplerDocument::paramsGetter)
@@ -181,7 +411,7 @@ NAN_GETTER(NodePopplerDocument::paramsGetter)
     }
     else if (strcmp(*propName, "isLinearized") == 0)
     {
-        info.GetReturnValue().Set(Nan::New<Boolean>(self->doc->isLinearized()));
+        info.GetReturnValue().Set(Nan::New<Boolean>(self->linearized));
     }
     else if (strcmp(*propName, "fileName") == 0)
     {
@@ -196,6 +426,10 @@ NAN_GETTER(NodePopplerDocument::paramsGetter)
             info.GetReturnValue().Set(Nan::New<String>(c_str, fileName->getLength())
                                           .ToLocalChecked());
         }
+        else if (self->mapping != NULL)
+        {
+            info.GetReturnValue().Set(Nan::New<String>(self->mappedFileName).ToLocalChecked());
+        }
         else
         {
             info.GetReturnValue().Set(Nan::Null());
@@ -211,57 +445,715 @@ NAN_METHOD(NodePopplerDocument::New)
 {
     Nan::HandleScope scope;
 
+    if (info.Length() == 1 && info[0]->IsExternal())
+    {
+        // Wrapping a document opened by PopplerDocument.open
+        NodePopplerDocument *doc = static_cast<NodePopplerDocument *>(info[0].As<External>()->Value());
+        doc->Wrap(info.This());
+        info.GetReturnValue().Set(info.This());
+        return;
+    }
+
     if (
-        !(0 < info.Length() && info.Length() <= 3)
-        || !(info[0]->IsString() || Buffer::HasInstance(info[0]))
+        !(0 < info.Length() && info.Length() <= 4)
+        || !(info[0]->IsString() || Buffer::HasInstance(info[0]) || info[0]->IsArrayBuffer())
         || !(info[1]->IsUndefined() || info[1]->IsNull() || info[1]->IsString())
-        || !(info[2]->IsUndefined() || info[2]->IsNull() || info[2]->IsString()))
+        || !(info[2]->IsUndefined() || info[2]->IsNull() || info[2]->IsString())
+        || !(info[3]->IsUndefined() || info[3]->IsNull() || info[3]->IsObject()))
+    {
+        return Nan::ThrowError("Supported arguments: (fileName: string | Buffer, userPassword?: string, ownerPassword?: string, options?: Object).");
+    }
+
+    OpenWork *work = new OpenWork();
+
+    work->setSource(info[0]);
+    if (work->error)
+    {
+        Local<Value> e = Nan::TypeError(work->error);
+        delete work;
+        return Nan::ThrowError(e);
+    }
+    if (work->loader)
+    {
+        delete work;
+        return Nan::ThrowError("A document read through 'read' must be opened with PopplerDocument.open.");
+    }
+    work->setPasswords(info[1], info[2]);
+
+    if (info[3]->IsObject())
+    {
+        work->setOptions(info[3]);
+        if (work->error)
+        {
+            Local<Value> e = Nan::Error(work->error);
+            delete work;
+            return Nan::ThrowError(e);
+        }
+    }
+
+    work->open();
+    if (work->error)
+    {
+        Local<Value> e = Nan::Error(work->error);
+        delete work;
+        return Nan::ThrowError(e);
+    }
+
+    NodePopplerDocument *doc = work->takeDocument();
+    delete work;
+    doc->Wrap(info.This());
+    info.GetReturnValue().Set(info.This());
+}
+
+/**
+     * Opens a document on a libuv worker thread
+     *
+     * Javascript function
+     *
+     * \param fileName String or Buffer \see NodePopplerDocument::New
+     * \param userPassword String \see NodePopplerDocument::New
+     * \param ownerPassword String \see NodePopplerDocument::New
+     * \param options Object \see NodePopplerDocument::New
+     * \param callback Function. Called with (err, PopplerDocument)
+     */
+NAN_METHOD(NodePopplerDocument::open)
+{
+    Nan::HandleScope scope;
+
+    if (
+        !(1 < info.Length() && info.Length() <= 5)
+        || !info[info.Length() - 1]->IsFunction())
     {
-        return Nan::ThrowError("Supported arguments: (fileName: string | Buffer, userPassword?: string, ownerPassword?: string).");
+        return Nan::ThrowError("Arguments: (fileName: String | Buffer[, userPassword: String, ownerPassword: String, options: Object], callback: Function).");
     }
 
-    NodePopplerDocument *doc;
+    OpenWork *work = new OpenWork();
+    work->callback = new Nan::Callback(info[info.Length() - 1].As<v8::Function>());
 
-    GooString* userPassword = nullptr;
-    GooString* ownerPassword = nullptr;
+    Local<Value> userPassword = info.Length() > 2 ? info[1] : Nan::Undefined().As<Value>();
+    Local<Value> ownerPassword = info.Length() > 3 ? info[2] : Nan::Undefined().As<Value>();
+    Local<Value> options = info.Length() > 4 ? info[3] : Nan::Undefined().As<Value>();
 
-    if (info[1]->IsString()) {
-        Nan::Utf8String jsUserPassword(To<String>(info[1]).ToLocalChecked());
-        userPassword = new GooString(*jsUserPassword);
+    if (
+        !(userPassword->IsUndefined() || userPassword->IsNull() || userPassword->IsString())
+        || !(ownerPassword->IsUndefined() || ownerPassword->IsNull() || ownerPassword->IsString())
+        || !(options->IsUndefined() || options->IsNull() || options->IsObject()))
+    {
+        Local<Value> err = Nan::Error("Supported arguments: (fileName: string | Buffer, userPassword?: string, ownerPassword?: string, options?: Object).");
+        THROW_ASYNC_ERR(work, err);
     }
 
-    if (info[2]->IsString()) {
-        Nan::Utf8String jsOwnerPassword(To<String>(info[2]).ToLocalChecked());
-        ownerPassword = new GooString(*jsOwnerPassword);
+    work->setSource(info[0]);
+    if (work->error)
+    {
+        Local<Value> err = Nan::TypeError(work->error);
+        THROW_ASYNC_ERR(work, err);
     }
+    work->setPasswords(userPassword, ownerPassword);
 
-    if (info[0]->IsString())
+    if (options->IsObject())
     {
-        Nan::Utf8String str(To<String>(info[0]).ToLocalChecked());
-        doc = new NodePopplerDocument(*str, ownerPassword, userPassword);
+        work->setOptions(options);
+        if (work->error)
+        {
+            Local<Value> err = Nan::Error(work->error);
+            THROW_ASYNC_ERR(work, err);
+        }
     }
-    else if (Buffer::HasInstance(info[0]))
+
+    uv_queue_work(uv_default_loop(), &work->request, AsyncOpenWork, AsyncOpenAfter);
+}
+
+void NodePopplerDocument::AsyncOpenWork(uv_work_t *req)
+{
+    OpenWork *work = static_cast<OpenWork *>(req->data);
+    work->open();
+}
+
+void NodePopplerDocument::AsyncOpenAfter(uv_work_t *req, int status)
+{
+    Nan::HandleScope scope;
+    OpenWork *work = static_cast<OpenWork *>(req->data);
+    Nan::AsyncResource res(Nan::New("poppler-simple::open").ToLocalChecked());
+
+    if (work->error)
     {
-        doc = new NodePopplerDocument(
-            Buffer::Data(info[0]),
-            Buffer::Length(info[0]),
-            userPassword,
-            ownerPassword);
+        Local<Value> argv[] = {Nan::Error(work->error)};
+        Nan::TryCatch try_catch;
+        work->callback->Call(1, argv, &res);
+        if (try_catch.HasCaught())
+        {
+            Nan::FatalException(try_catch);
+        }
     }
     else
     {
-        return Nan::ThrowTypeError("'filename' must be an instance of String or Buffer.");
+        Local<Value> ctorArgv[] = {Nan::New<External>(work->takeDocument())};
+        Local<v8::Object> instance = Nan::NewInstance(Nan::New(constructor), 1, ctorArgv).ToLocalChecked();
+        Local<Value> argv[] = {Nan::Null(), instance};
+        Nan::TryCatch try_catch;
+        work->callback->Call(2, argv, &res);
+        if (try_catch.HasCaught())
+        {
+            Nan::FatalException(try_catch);
+        }
     }
 
-    if (!doc->isOk())
+    delete work;
+}
+
+/**
+     * Renders many pages to Buffers with a single native call
+     *
+     * Javascript function
+     *
+     * \param options Object with fields:
+     *   pages: Array of page numbers (default: all pages)
+     *   method: String \see NodePopplerPage::renderToFile
+     *   PPI: Number \see NodePopplerPage::renderToFile
+     *   options: Object \see NodePopplerPage::renderToFile
+     * \param callback Function. Called with (err, Array of Buffers) in order of `pages`
+     */
+NAN_METHOD(NodePopplerDocument::renderPages)
+{
+    Nan::HandleScope scope;
+    NodePopplerDocument *self = Nan::ObjectWrap::Unwrap<NodePopplerDocument>(info.Holder());
+
+    if (info.Length() != 2 || !info[0]->IsObject() || !info[1]->IsFunction())
+    {
+        return Nan::ThrowError("Arguments: (options: {pages?: Array, method: String, PPI: Number, options?: Object}, callback: Function)");
+    }
+
+    BatchRenderWork *batch = new BatchRenderWork();
+    batch->callback = new Nan::Callback(info[1].As<v8::Function>());
+    batch->docHandle.Reset(info.Holder());
+
+    Local<v8::Object> opts = To<v8::Object>(info[0]).ToLocalChecked();
+    Local<Value> pagesVal = Nan::Get(opts, Nan::New("pages").ToLocalChecked()).ToLocalChecked();
+    Local<Value> methodVal = Nan::Get(opts, Nan::New("method").ToLocalChecked()).ToLocalChecked();
+    Local<Value> ppiVal = Nan::Get(opts, Nan::New("PPI").ToLocalChecked()).ToLocalChecked();
+    Local<Value> writerOptsVal = Nan::Get(opts, Nan::New("options").ToLocalChecked()).ToLocalChecked();
+
+    std::vector<int32_t> pageNums;
+    if (pagesVal->IsUndefined() || pagesVal->IsNull())
+    {
+        for (int32_t i = 1; i <= self->doc->getNumPages(); i++)
+        {
+            pageNums.push_back(i);
+        }
+    }
+    else if (pagesVal->IsArray())
     {
-        int errorCode = doc->getDoc()->getErrorCode();
+        Local<v8::Array> pagesArr = pagesVal.As<v8::Array>();
+        for (uint32_t i = 0; i < pagesArr->Length(); i++)
+        {
+            Local<Value> pv = Nan::Get(pagesArr, i).ToLocalChecked();
+            if (!pv->IsUint32())
+            {
+                Local<Value> err = Nan::TypeError("'pages' must be an Array of Uint32.");
+                THROW_ASYNC_ERR(batch, err);
+            }
+            int32_t pageNum = To<int32_t>(pv).FromJust();
+            if (0 >= pageNum || pageNum > self->doc->getNumPages())
+            {
+                Local<Value> err = Nan::Error("Page number out of bounds.");
+                THROW_ASYNC_ERR(batch, err);
+            }
+            pageNums.push_back(pageNum);
+        }
+    }
+    else
+    {
+        Local<Value> err = Nan::TypeError("'pages' must be an Array of Uint32.");
+        THROW_ASYNC_ERR(batch, err);
+    }
+
+    if (pageNums.empty())
+    {
+        Local<Value> argv[] = {Nan::Null(), Nan::New<v8::Array>(0)};
+        Nan::TryCatch try_catch;
+        Nan::Call(*batch->callback, 2, argv);
+        if (try_catch.HasCaught())
+        {
+            Nan::FatalException(try_catch);
+        }
+        delete batch;
+        return;
+    }
+
+    for (int32_t pageNum : pageNums)
+    {
+        NodePopplerPage *page = new NodePopplerPage(self, pageNum);
+        batch->pages.push_back(page);
+        if (!page->isOk() && self->isStreamed())
+        {
+            char e[160];
+            snprintf(e, sizeof(e), "Page %d of a document read through 'read' must be loaded with getPageAsync first.", pageNum);
+            Local<Value> err = Nan::Error(e);
+            THROW_ASYNC_ERR(batch, err);
+        }
+        if (!page->isOk())
+        {
+            Local<Value> err = Nan::Error("Can't open page.");
+            THROW_ASYNC_ERR(batch, err);
+        }
+        batch->works.push_back(new NodePopplerPage::RenderWork(page, NodePopplerPage::DEST_BUFFER));
+    }
+
+    // Options are parsed once and copied to the rest of the pages
+    NodePopplerPage::RenderWork *first = batch->works[0];
+    if (!methodVal->IsString())
+    {
+        Local<Value> err = Nan::TypeError("'method' must be an instance of String");
+        THROW_ASYNC_ERR(batch, err);
+    }
+    first->setWriter(methodVal);
+    if (!first->error && first->w == NodePopplerPage::W_RAW)
+    {
+        // results are encoded images, raw pixels need their size and layout
+        Local<Value> err = Nan::Error("'raw' method is not supported by renderPages, use renderToBufferAsync.");
+        THROW_ASYNC_ERR(batch, err);
+    }
+    if (first->error)
+    {
+        Local<Value> err = Nan::Error(first->error);
+        THROW_ASYNC_ERR(batch, err);
+    }
+    first->setPPI(ppiVal);
+    if (first->error)
+    {
+        Local<Value> err = Nan::Error(first->error);
+        THROW_ASYNC_ERR(batch, err);
+    }
+    if (writerOptsVal->IsObject())
+    {
+        first->setWriterOptions(writerOptsVal);
+        if (first->error)
+        {
+            Local<Value> err = Nan::Error(first->error);
+            THROW_ASYNC_ERR(batch, err);
+        }
+    }
+    for (size_t i = 1; i < batch->works.size(); i++)
+    {
+        batch->works[i]->copySettings(first);
+    }
+
+    batch->requests.resize(batch->works.size());
+    for (uv_work_t &request : batch->requests)
+    {
+        request.data = batch;
+        RenderPool::queue(&request, AsyncRenderPagesWork, AsyncRenderPagesAfter, first->priority);
+    }
+}
+
+void NodePopplerDocument::AsyncRenderPagesWork(uv_work_t *req)
+{
+    BatchRenderWork *batch = static_cast<BatchRenderWork *>(req->data);
+    if (batch->failed)
+    {
+        return;
+    }
+    // Each page takes its own render context, released ones are reused warm
+    NodePopplerPage::RenderWork *work = batch->works[req - batch->requests.data()];
+    work->openStream();
+    if (!work->error)
+    {
+        NodePopplerPage::display(work);
+        work->closeStream();
+    }
+    if (work->error)
+    {
+        batch->failed = true;
+    }
+}
+
+/**
+     * Extracts the words of all pages on render threads into a TextIndex
+     *
+     * \param callback Function
+     */
+NAN_METHOD(NodePopplerDocument::buildTextIndex)
+{
+    Nan::HandleScope scope;
+    NodePopplerDocument *self = Nan::ObjectWrap::Unwrap<NodePopplerDocument>(info.Holder());
+
+    if (info.Length() < 1 || !info[0]->IsFunction())
+    {
+        return Nan::ThrowError("Arguments: (callback: Function)");
+    }
+
+    int pageCount = self->doc->getNumPages();
+    size_t tasks = std::max<size_t>(1, std::min<size_t>(RenderPool::getConcurrency(), pageCount));
+    TextIndexWork *work = new TextIndexWork(tasks, pageCount);
+    work->callback = new Nan::Callback(info[0].As<v8::Function>());
+    work->doc = self;
+    work->docHandle.Reset(info.Holder());
+    for (uv_work_t &request : work->requests)
+    {
+        RenderPool::queue(&request, AsyncTextIndexWork, AsyncTextIndexAfter, RenderPool::P_LOW);
+    }
+}
+
+/**
+     * Reads a page on a render thread, so that opening it afterwards doesn't
+     * need to fetch data. Meant for documents read through `read`.
+     *
+     * \param pageNum Number
+     * \param callback Function. Called with (err), without an error also
+     *                 for a page number out of bounds
+     */
+NAN_METHOD(NodePopplerDocument::loadPage)
+{
+    Nan::HandleScope scope;
+    NodePopplerDocument *self = Nan::ObjectWrap::Unwrap<NodePopplerDocument>(info.Holder());
+
+    if (info.Length() < 2 || !info[0]->IsNumber() || !info[1]->IsFunction())
+    {
+        return Nan::ThrowError("Arguments: (pageNum: Number, callback: Function)");
+    }
+
+    LoadPageWork *work = new LoadPageWork();
+    work->callback = new Nan::Callback(info[1].As<v8::Function>());
+    work->pageNum = To<int32_t>(info[0]).FromJust();
+    work->doc = self;
+    work->docHandle.Reset(info.Holder());
+    RenderPool::queue(&work->request, AsyncLoadPageWork, AsyncLoadPageAfter, RenderPool::P_HIGH);
+}
+
+void NodePopplerDocument::AsyncLoadPageWork(uv_work_t *req)
+{
+    LoadPageWork *work = static_cast<LoadPageWork *>(req->data);
+    std::lock_guard<std::mutex> guard(work->doc->renderContexts->sharedLock());
+    PDFDoc *doc = work->doc->getDoc();
+    work->inBounds = 1 <= work->pageNum && work->pageNum <= doc->getNumPages();
+    if (work->inBounds)
+    {
+        Page *page = doc->getPage(work->pageNum);
+        work->page = page != NULL && page->isOk() ? page : NULL;
+        if (work->page != NULL)
+        {
+            // numAnnots reads them from the main thread
+            work->page->getAnnots();
+        }
+    }
+}
+
+void NodePopplerDocument::AsyncLoadPageAfter(uv_work_t *req, int status)
+{
+    Nan::HandleScope scope;
+    LoadPageWork *work = static_cast<LoadPageWork *>(req->data);
+    if (work->page != NULL)
+    {
+        // the Catalog keeps the page, so it can be opened without touching the document
+        work->doc->loadedPages[work->pageNum] = work->page;
+    }
+    Local<Value> argv[] = {work->page != NULL || !work->inBounds ? Nan::Null().As<Value>() : Nan::Error("Couldn't read page.")};
+    Nan::TryCatch try_catch;
+    Nan::AsyncResource res(Nan::New("poppler-simple::load-page").ToLocalChecked());
+    work->callback->Call(1, argv, &res);
+    if (try_catch.HasCaught())
+    {
+        Nan::FatalException(try_catch);
+    }
+    delete work;
+}
+
+void NodePopplerDocument::AsyncTextIndexWork(uv_work_t *req)
+{
+    TextIndexWork *work = static_cast<TextIndexWork *>(req->data);
+    RenderContextPool *contexts = work->doc->renderContexts.get();
+    PDFDoc *clone = contexts->openClone();
+
+    for (int i = work->nextPage++; i < (int)work->pages.size(); i = work->nextPage++)
+    {
+        std::unique_lock<std::mutex> guard(contexts->sharedLock(), std::defer_lock);
+        PDFDoc *doc = clone;
+        if (doc == NULL)
+        {
+            guard.lock();
+            doc = work->doc->getDoc();
+        }
+        Page *page = doc->getPage(i + 1);
+        if (page == NULL)
+            continue;
+        TextPage *text = NodePopplerPage::layoutText(page, false);
+        NodePopplerPage::wordBoxes(text, NodePopplerPage::pageWidth(page), NodePopplerPage::pageHeight(page), work->pages[i]);
+        text->decRefCnt();
+    }
+    if (clone != NULL)
+        delete clone;
+
+    if (--work->running == 0)
+    {
+        TextIndex *index = new TextIndex();
+        index->setPageCount(work->pages.size());
+        for (size_t i = 0; i < work->pages.size(); i++)
+        {
+            for (const NodePopplerPage::TextBox &box : work->pages[i])
+                index->addWord(i + 1, box.text, box.x1, box.y1, box.x2, box.y2);
+            std::vector<NodePopplerPage::TextBox>().swap(work->pages[i]);
+        }
+        work->index = index;
+    }
+}
+
+void NodePopplerDocument::AsyncTextIndexAfter(uv_work_t *req, int status)
+{
+    Nan::HandleScope scope;
+    TextIndexWork *work = static_cast<TextIndexWork *>(req->data);
+    if (++work->finished < work->requests.size())
+    {
+        return;
+    }
+
+    Local<Value> argv[] = {Nan::Null(), NodeTextIndex::NewInstance(work->index)};
+    work->index = NULL;
+    Nan::TryCatch try_catch;
+    Nan::AsyncResource res(Nan::New("poppler-simple::text-index").ToLocalChecked());
+    work->callback->Call(2, argv, &res);
+    if (try_catch.HasCaught())
+    {
+        Nan::FatalException(try_catch);
+    }
+    delete work;
+}
+
+void NodePopplerDocument::AsyncRenderPagesAfter(uv_work_t *req, int status)
+{
+    Nan::HandleScope scope;
+    BatchRenderWork *batch = static_cast<BatchRenderWork *>(req->data);
+    if (++batch->finished < batch->requests.size())
+    {
+        return;
+    }
+    Nan::AsyncResource res(Nan::New("poppler-simple::render-pages").ToLocalChecked());
+
+    // the failed page coming first in `pages` is reported
+    for (size_t i = 0; i < batch->works.size() && !batch->error; i++)
+    {
+        NodePopplerPage::RenderWork *work = batch->works[i];
+        if (work->error)
+        {
+            char err[512];
+            snprintf(err, sizeof(err), "Page %d: %s", batch->pages[i]->getNum(), work->error);
+            batch->error = new char[strlen(err) + 1];
+            strcpy(batch->error, err);
+            batch->errorCode = work->errorCode;
+        }
+    }
+
+    if (batch->error)
+    {
+        Local<Value> argv[] = {NodePopplerPage::renderError(batch->error, batch->errorCode)};
+        Nan::TryCatch try_catch;
+        batch->callback->Call(1, argv, &res);
+        if (try_catch.HasCaught())
+        {
+            Nan::FatalException(try_catch);
+        }
+    }
+    else
+    {
+        Local<v8::Array> results = Nan::New<v8::Array>(batch->works.size());
+        for (size_t i = 0; i < batch->works.size(); i++)
+        {
+            NodePopplerPage::RenderWork *work = batch->works[i];
+            // Buffer takes ownership of the encoded image
+            Nan::Set(results, i, Nan::NewBuffer(work->mstrm_buf, work->mstrm_len).ToLocalChecked());
+            work->mstrm_buf = NULL;
+        }
+        Local<Value> argv[] = {Nan::Null(), results};
+        Nan::TryCatch try_catch;
+        batch->callback->Call(2, argv, &res);
+        if (try_catch.HasCaught())
+        {
+            Nan::FatalException(try_catch);
+        }
+    }
+
+    delete batch;
+}
+
+void NodePopplerDocument::OpenWork::setSource(const Local<Value> source)
+{
+    Nan::HandleScope scope;
+    char *e = NULL;
+    if (source->IsString())
+    {
+        Nan::Utf8String str(To<String>(source).ToLocalChecked());
+        this->fileName = new char[str.length() + 1];
+        memcpy(this->fileName, *str, str.length());
+        this->fileName[str.length()] = 0;
+    }
+    else if (Buffer::HasInstance(source) || source->IsArrayBuffer())
+    {
+        Local<v8::Object> view;
+        if (source->IsArrayBuffer())
+        {
+            Local<ArrayBuffer> ab = source.As<ArrayBuffer>();
+            view = Uint8Array::New(ab, 0, ab->ByteLength());
+            this->arrayBuffer = true;
+        }
+        else
+        {
+            view = To<v8::Object>(source).ToLocalChecked();
+        }
+        // Buffer contents are read on a worker thread when opened asynchronously
+        // and for the whole document lifetime when not copied,
+        // so keep the Buffer alive.
+        this->bufferHandle.Reset(view);
+        this->buffer = Buffer::Data(view);
+        this->length = Buffer::Length(view);
+    }
+    else if (source->IsObject())
+    {
+        // {size: Number, read: Function(offset, length, callback)}
+        Local<v8::Object> obj = To<v8::Object>(source).ToLocalChecked();
+        Local<Value> size = Nan::Get(obj, Nan::New("size").ToLocalChecked()).ToLocalChecked();
+        Local<Value> read = Nan::Get(obj, Nan::New("read").ToLocalChecked()).ToLocalChecked();
+        if (!size->IsNumber() || To<double>(size).FromJust() < 0 || !read->IsFunction())
+        {
+            e = (char *)"'size' must be a non-negative number and 'read' a function.";
+        }
+        else
+        {
+            this->loader = new RangeLoader(read.As<v8::Function>(), (size_t)To<double>(size).FromJust());
+        }
+    }
+    else
+    {
+        e = (char *)"'filename' must be an instance of String or Buffer.";
+    }
+    if (e)
+    {
+        this->error = new char[strlen(e) + 1];
+        strcpy(this->error, e);
+    }
+}
+
+void NodePopplerDocument::OpenWork::setPasswords(const Local<Value> user, const Local<Value> owner)
+{
+    Nan::HandleScope scope;
+    if (user->IsString())
+    {
+        Nan::Utf8String jsUserPassword(To<String>(user).ToLocalChecked());
+        this->userPassword = new GooString(*jsUserPassword);
+    }
+    if (owner->IsString())
+    {
+        Nan::Utf8String jsOwnerPassword(To<String>(owner).ToLocalChecked());
+        this->ownerPassword = new GooString(*jsOwnerPassword);
+    }
+}
+
+void NodePopplerDocument::OpenWork::setOptions(const Local<Value> optsVal)
+{
+    Nan::HandleScope scope;
+
+    Local<String> cbk = Nan::New("copyBuffer").ToLocalChecked();
+    Local<String> mk = Nan::New("mmap").ToLocalChecked();
+    Local<String> tck = Nan::New("textCacheSize").ToLocalChecked();
+    Local<String> rtk = Nan::New("readTimeoutMs").ToLocalChecked();
+    Local<v8::Object> options;
+    char *e = NULL;
+
+    if (!To<v8::Object>(optsVal).ToLocal(&options))
+    {
+        e = (char *)"'options' must be an instance of Object";
+    }
+    else
+    {
+        if (Nan::Has(options, cbk).FromMaybe(false))
+        {
+            Local<Value> cbv = Nan::Get(options, cbk).ToLocalChecked();
+            if (cbv->IsBoolean())
+            {
+                this->copyBuffer = To<bool>(cbv).FromJust();
+                if (!this->copyBuffer && this->arrayBuffer)
+                {
+                    e = (char *)"'copyBuffer' can be false only for a Buffer, an ArrayBuffer may be detached";
+                }
+            }
+            else
+            {
+                e = (char *)"'copyBuffer' option value must be a boolean value";
+            }
+        }
+        if (Nan::Has(options, mk).FromMaybe(false))
+        {
+            Local<Value> mv = Nan::Get(options, mk).ToLocalChecked();
+            if (mv->IsBoolean())
+            {
+                this->mmap = To<bool>(mv).FromJust();
+            }
+            else
+            {
+                e = (char *)"'mmap' option value must be a boolean value";
+            }
+        }
+        if (Nan::Has(options, tck).FromMaybe(false))
+        {
+            Local<Value> tcv = Nan::Get(options, tck).ToLocalChecked();
+            if (tcv->IsNumber() && To<double>(tcv).FromJust() >= 0)
+            {
+                this->textCacheSize = (size_t)To<double>(tcv).FromJust();
+            }
+            else
+            {
+                e = (char *)"'textCacheSize' option value must be a non-negative number";
+            }
+        }
+        if (Nan::Has(options, rtk).FromMaybe(false))
+        {
+            Local<Value> rtv = Nan::Get(options, rtk).ToLocalChecked();
+            if (rtv->IsUint32())
+            {
+                if (this->loader)
+                    this->loader->setTimeout(To<uint32_t>(rtv).FromJust());
+            }
+            else
+            {
+                e = (char *)"'readTimeoutMs' option value must be a non-negative integer";
+            }
+        }
+    }
+    if (e)
+    {
+        this->error = new char[strlen(e) + 1];
+        strcpy(this->error, e);
+    }
+}
+
+/**
+     * Parses the document. Does not touch V8, so it is safe to call on a worker thread.
+     */
+void NodePopplerDocument::OpenWork::open()
+{
+    bool streamed = this->loader != NULL;
+    if (this->fileName)
+    {
+        this->doc = new NodePopplerDocument((const char *)this->fileName, this->mmap, this->ownerPassword, this->userPassword);
+    }
+    else if (this->loader)
+    {
+        this->doc = new NodePopplerDocument(this->loader, this->ownerPassword, this->userPassword);
+        this->loader = NULL;
+    }
+    else
+    {
+        this->doc = new NodePopplerDocument(this->buffer, this->length, this->copyBuffer, this->ownerPassword, this->userPassword);
+    }
+
+    if (!this->doc->isOk())
+    {
+        int errorCode = this->doc->getErrorCode();
         char errorName[128];
         char errorDescription[256];
         switch (errorCode)
         {
         case errOpenFile:
-            sprintf(errorName, "fopen error. Errno: %d", doc->getDoc()->getFopenErrno());
+            sprintf(errorName, "fopen error. Errno: %d", this->doc->getFopenErrno());
             break;
         case errBadCatalog:
             sprintf(errorName, "bad catalog");
@@ -294,11 +1186,32 @@ NAN_METHOD(NodePopplerDocument::New)
             sprintf(errorName, "other error");
         }
         sprintf(errorDescription, "Couldn't open file - %s.", errorName);
-        delete doc;
-        return Nan::ThrowError(Exception::Error(Nan::New<String>(errorDescription, strlen(errorDescription)).ToLocalChecked()));
+        this->error = new char[strlen(errorDescription) + 1];
+        strcpy(this->error, errorDescription);
+        delete this->doc;
+        this->doc = NULL;
+    }
+    else
+    {
+        // read here, the main thread can't wait for data of a streamed document
+        this->doc->linearized = this->doc->getDoc()->isLinearized();
+        if (streamed)
+        {
+            // fetch the page tree here too
+            this->doc->getDoc()->getNumPages();
+        }
+        this->doc->renderContexts.reset(new RenderContextPool(this->doc->getDoc(), this->ownerPassword, this->userPassword, streamed));
+        if (this->doc->buffer != NULL)
+        {
+            this->doc->renderContexts->setContentData(this->doc->buffer, this->length);
+        }
+        else if (this->doc->mapping != NULL || (!this->fileName && !streamed))
+        {
+            // the caller's Buffer or the mapped file can change under the document
+            this->doc->renderContexts->setMutableSource();
+        }
+        this->doc->textLayouts.reset(new TextLayoutCache(this->textCacheSize));
     }
-    doc->Wrap(info.This());
-    info.GetReturnValue().Set(info.This());
 }
 
 } // namespace node
@@ -1,3 +1,4 @@
+#include <map>
 #include <v8.h>
 #include <node.h>
 #include <nan.h>
@@ -5,33 +6,140 @@
 #include <poppler/PDFDoc.h>
 #include <poppler/ErrorCodes.h>
 #include <poppler/PDFDocFactory.h>
+#include <poppler/CachedFile.h>
 #include <goo/GooString.h>
 
+#include "RangeLoader.h"
+#include "RenderContextPool.h"
+#include "TextLayoutCache.h"
+
 namespace node {
     class NodePopplerPage;
     class NodePopplerDocument : public Nan::ObjectWrap {
     public:
+        class OpenWork
+        {
+        public:
+            OpenWork()
+                : callback(NULL), error(NULL), fileName(NULL), buffer(NULL), length(0), arrayBuffer(false), copyBuffer(true), mmap(false), textCacheSize(32 << 20), loader(NULL), userPassword(NULL), ownerPassword(NULL), doc(NULL)
+            {
+                request.data = this;
+            }
+            ~OpenWork()
+            {
+                if (error)
+                    delete[] error;
+                if (fileName)
+                    delete[] fileName;
+                if (userPassword)
+                    delete userPassword;
+                if (ownerPassword)
+                    delete ownerPassword;
+                if (callback != NULL)
+                    delete callback;
+                if (doc)
+                    delete doc;
+                if (loader)
+                    delete loader;
+                bufferHandle.Reset();
+            }
+            void setSource(const v8::Local<v8::Value> source);
+            void setPasswords(const v8::Local<v8::Value> user, const v8::Local<v8::Value> owner);
+            void setOptions(const v8::Local<v8::Value> optsVal);
+            void open();
+            NodePopplerDocument *takeDocument()
+            {
+                NodePopplerDocument *d = doc;
+                doc = NULL;
+                if (d && !copyBuffer)
+                {
+                    // The document reads straight from the caller's memory
+                    d->source.Reset(Nan::New(bufferHandle));
+                }
+                return d;
+            }
+
+            uv_work_t request;
+            Nan::Callback *callback;
+            char *error;
+            char *fileName;
+            char *buffer;
+            size_t length;
+            // an ArrayBuffer can be detached, so its data is always copied
+            bool arrayBuffer;
+            bool copyBuffer;
+            bool mmap;
+            size_t textCacheSize;
+            Nan::Persistent<v8::Object> bufferHandle;
+            // reads a document given as {size, read}, until the document takes it over
+            RangeLoader *loader;
+            GooString *userPassword;
+            GooString *ownerPassword;
+            NodePopplerDocument *doc;
+        };
+
         NodePopplerDocument(
             const char* cFileName,
+            bool map,
             GooString* ownerPassword = nullptr,
             GooString* userPassword = nullptr);
         NodePopplerDocument(
             char* buffer,
             size_t length,
+            bool copy,
+            GooString* ownerPassword = nullptr,
+            GooString* userPassword = nullptr);
+        /**
+         * Opens a document read through `loader`, which the document takes over.
+         */
+        NodePopplerDocument(
+            CachedFileLoader* loader,
             GooString* ownerPassword = nullptr,
             GooString* userPassword = nullptr);
         ~NodePopplerDocument();
 
         inline bool isOk() {
-            return doc->isOk();
+            return doc && doc->isOk();
+        }
+        inline int getErrorCode() {
+            return doc ? doc->getErrorCode() : errOpenFile;
+        }
+        inline int getFopenErrno() {
+            return doc ? doc->getFopenErrno() : mapErrno;
         }
         inline PDFDoc *getDoc() {
             return doc.get();
         }
+        /**
+         * Tells whether the document data is read through a JS `read` function.
+         * Such documents can't be used from the main thread while they render.
+         */
+        inline bool isStreamed() {
+            return renderContexts && renderContexts->isStreamed();
+        }
+        /**
+         * Page of a streamed document read by loadPage, or NULL. Main thread only.
+         */
+        inline Page *getLoadedPage(int num) {
+            auto it = loadedPages.find(num);
+            return it == loadedPages.end() ? NULL : it->second;
+        }
         static NAN_MODULE_INIT(Init);
 
     protected:
         static NAN_METHOD(New);
+        static NAN_METHOD(open);
+        static void AsyncOpenWork(uv_work_t *req);
+        static void AsyncOpenAfter(uv_work_t *req, int status);
+        static NAN_METHOD(renderPages);
+        static void AsyncRenderPagesWork(uv_work_t *req);
+        static void AsyncRenderPagesAfter(uv_work_t *req, int status);
+        static NAN_METHOD(buildTextIndex);
+        static void AsyncTextIndexWork(uv_work_t *req);
+        static void AsyncTextIndexAfter(uv_work_t *req, int status);
+        static NAN_METHOD(loadPage);
+        static void AsyncLoadPageWork(uv_work_t *req);
+        static void AsyncLoadPageAfter(uv_work_t *req, int status);
         void evPageOpened(NodePopplerPage *p);
         void evPageClosed(NodePopplerPage *p);
         std::vector<NodePopplerPage*> pages;
@@ -39,8 +147,24 @@ namespace node {
     private:
         static NAN_GETTER(paramsGetter);
 
+        static Nan::Persistent<v8::Function> constructor;
+
         friend class NodePopplerPage;
         std::unique_ptr<PDFDoc> doc;
+        // owned copy of the document data, NULL for zero-copy and file documents
         char *buffer;
+        std::unique_ptr<RenderContextPool> renderContexts;
+        std::unique_ptr<TextLayoutCache> textLayouts;
+        // caller's Buffer backing a zero-copy document
+        Nan::Persistent<v8::Object> source;
+        // read-only file mapping backing a memory-mapped document
+        void *mapping;
+        size_t mappingLength;
+        int mapErrno;
+        std::string mappedFileName;
+        // read while opening, a streamed document can't be read from the main thread
+        bool linearized;
+        // pages of a streamed document read on a worker thread, by number
+        std::map<int, Page *> loadedPages;
     };
 }
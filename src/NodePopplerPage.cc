@@ -1,10 +1,17 @@
 #include <v8.h>
+#include <algorithm>
+#include <cerrno>
+#include <climits>
 #include <memory>
 #include <node.h>
 #include <node_buffer.h>
 
 #include "NodePopplerDocument.h"
 #include "NodePopplerPage.h"
+#include "RenderCache.h"
+#include "RenderContextPool.h"
+#include "AhoCorasick.h"
+#include <poppler/UnicodeTypeTable.h>
 
 int getNumAnnotsHelper(Annots &annots) {
 #if ((POPPLER_VERSION_MAJOR == 22) && (POPPLER_VERSION_MINOR >= 3)) || POPPLER_VERSION_MAJOR > 22
@@ -22,6 +29,38 @@ Annot *getAnnotHelper(Annots &annots, int i) {
 #endif
 }
 
+// Main thread calls on a streamed document could wait for the shared document
+// while the render holding it waits for the main thread to read data
+static const char *const STREAMED_SYNC_ERROR = "Documents read through 'read' support only asynchronous calls";
+
+// a render context's document can fail to read a page the main document had
+static const char *const PAGE_READ_ERROR = "Couldn't read page.";
+
+// Older TiffWriter hands fileno() of the stream to libtiff, so it can't
+// write into a cookie stream and needs a real temporary file.
+
+bool tiffNeedsFileHelper() {
+#if POPPLER_VERSION_MAJOR == 0 && POPPLER_VERSION_MINOR < 22
+    return true;
+#else
+    return false;
+#endif
+}
+
+/**
+ * Packs `width` pixels of a Mono1 row from pixel `x` on for a MONOCHROME
+ * writer, which takes set bits as black while Splash sets them for white
+ */
+void packMonoRow(const unsigned char *src, int x, int width, unsigned char *dst) {
+    memset(dst, 0, (width + 7) / 8);
+    for (int i = 0; i < width; i++) {
+        int bit = x + i;
+        if (!(src[bit >> 3] & (0x80 >> (bit & 7)))) {
+            dst[i >> 3] |= 0x80 >> (i & 7);
+        }
+    }
+}
+
 #define THROW_SYNC_ASYNC_ERR(work, err)      \
     if (work->callback == NULL)              \
     {                                        \
@@ -56,8 +95,12 @@ NAN_MODULE_INIT(NodePopplerPage::Init)
 
     Nan::SetPrototypeMethod(tpl, "renderToFile", NodePopplerPage::renderToFile);
     Nan::SetPrototypeMethod(tpl, "renderToBuffer", NodePopplerPage::renderToBuffer);
+    Nan::SetPrototypeMethod(tpl, "renderTiles", NodePopplerPage::renderTiles);
+    Nan::SetPrototypeMethod(tpl, "renderProgressive", NodePopplerPage::renderProgressive);
+    Nan::SetPrototypeMethod(tpl, "renderBands", NodePopplerPage::renderBands);
     Nan::SetPrototypeMethod(tpl, "findText", NodePopplerPage::findText);
     Nan::SetPrototypeMethod(tpl, "getWordList", NodePopplerPage::getWordList);
+    Nan::SetPrototypeMethod(tpl, "loadText", NodePopplerPage::loadText);
     Nan::SetPrototypeMethod(tpl, "addAnnot", NodePopplerPage::addAnnot);
     Nan::SetPrototypeMethod(tpl, "deleteAnnots", NodePopplerPage::deleteAnnots);
 
@@ -80,10 +123,6 @@ NAN_MODULE_INIT(NodePopplerPage::Init)
 
 NodePopplerPage::~NodePopplerPage()
 {
-    if (text != NULL)
-    {
-        text->decRefCnt();
-    }
     if (!docClosed)
     {
         parent->evPageClosed(this);
@@ -91,9 +130,18 @@ NodePopplerPage::~NodePopplerPage()
 }
 
 NodePopplerPage::NodePopplerPage(NodePopplerDocument *doc, const int32_t pageNum)
-    : text(NULL), color_r(0), color_g(1), color_b(0)
+    : color_r(0), color_g(1), color_b(0)
 {
-    pg = doc->doc->getPage(pageNum);
+    if (doc->isStreamed())
+    {
+        // pages of a streamed document are read on a worker by loadPage
+        pg = doc->getLoadedPage(pageNum);
+    }
+    else
+    {
+        std::lock_guard<std::mutex> guard(doc->renderContexts->sharedLock());
+        pg = doc->doc->getPage(pageNum);
+    }
     if (pg && pg->isOk())
     {
         parent = doc;
@@ -138,6 +186,10 @@ NAN_METHOD(NodePopplerPage::New)
     {
         return Nan::ThrowError("Page number out of bounds.");
     }
+    if (doc->isStreamed() && doc->getLoadedPage(pageNum) == NULL)
+    {
+        return Nan::ThrowError("Pages of a document read through 'read' must be opened with getPageAsync.");
+    }
 
     NodePopplerPage *page = new NodePopplerPage(doc, pageNum);
     if (!page->isOk())
@@ -232,6 +284,12 @@ NAN_GETTER(NodePopplerPage::paramsGetter)
     }
     else if (strcmp(*propName, "numAnnots") == 0)
     {
+        // loadPage reads the annotations of a streamed page, and they can't change
+        std::unique_lock<std::mutex> guard(self->parent->renderContexts->sharedLock(), std::defer_lock);
+        if (!self->parent->isStreamed())
+        {
+            guard.lock();
+        }
         Annots *annots = self->pg->getAnnots();
         info.GetReturnValue().Set(Nan::New<Uint32>(getNumAnnotsHelper(*annots)));
     }
@@ -246,39 +304,74 @@ NAN_GETTER(NodePopplerPage::paramsGetter)
 }
 
 /**
-     * \return Object Array of Objects which represents individual words on page
-     *                and stores word text and relative coords
+     * Runs text layout of a page. The caller owns the returned TextPage.
      */
-NAN_METHOD(NodePopplerPage::getWordList)
+TextPage *NodePopplerPage::layoutText(Page *page, bool rawOrder)
 {
-    Nan::HandleScope scope;
-    NodePopplerPage *self = Nan::ObjectWrap::Unwrap<NodePopplerPage>(info.Holder());
-    TextPage *text;
-
-    bool rawOrder = info[0]->IsBoolean() ? (To<bool>(info[0]).FromMaybe(false) ? true : false) : false;
+    TextOutputDev *textDev;
+    Gfx *gfx;
+    textDev = new TextOutputDev(NULL, true, 0, rawOrder, false);
+    gfx = page->createGfx(textDev, 72., 72., 0,
+                          false,
+                          true,
+                          -1, -1, -1, -1,
+                          false, NULL, NULL);
+    page->display(gfx);
+    textDev->endPage();
+    TextPage *text = textDev->takeText();
+    delete gfx;
+    delete textDev;
+    return text;
+}
 
-    if (self->isDocClosed())
+/**
+     * Text layout of the page from the document's cache, laid out on a miss.
+     * Call with the shared document locked; release the result with decRefCnt().
+     */
+TextPage *NodePopplerPage::getTextPage(bool rawOrder)
+{
+    TextLayoutCache *cache = parent->textLayouts.get();
+    TextPage *text = cache->get(pg->getNum(), rawOrder);
+    if (text == NULL)
     {
-        return Nan::ThrowError("Document closed. You must delete this page");
+        text = layoutText(pg, rawOrder);
+        cache->put(pg->getNum(), rawOrder, text);
     }
+    return text;
+}
+
+/**
+     * Extracts words of the page. Runs on any thread.
+     */
+void NodePopplerPage::collectWords(bool rawOrder, std::vector<TextBox> &boxes)
+{
+    std::lock_guard<std::mutex> guard(parent->renderContexts->sharedLock());
+    TextPage *text = getTextPage(rawOrder);
+    wordBoxes(text, getWidth(), getHeight(), boxes);
+    text->decRefCnt();
+}
 
-    text = self->getTextPage(rawOrder);
+/**
+     * Converts words of a laid out page of `width` x `height` pts to relative boxes
+     */
+void NodePopplerPage::wordBoxes(TextPage *text, double width, double height, std::vector<TextBox> &boxes)
+{
     auto wordList = text->makeWordList(true);
     int l = wordList->getLength();
-    Local<v8::Array> v8results = Nan::New<v8::Array>(l);
+    boxes.resize(l);
     for (int i = 0; i < l; i++)
     {
-        Local<v8::Object> v8result = Nan::New<v8::Object>();
+        TextBox &box = boxes[i];
         TextWord *word = wordList->get(i);
         GooString *str = word->getText();
         double x1, y1, x2, y2;
 
         word->getBBox(&x1, &y1, &x2, &y2);
         // Make coords relative
-        x1 /= self->getWidth();
-        x2 /= self->getWidth();
-        y1 /= self->getHeight();
-        y2 /= self->getHeight();
+        x1 /= width;
+        x2 /= width;
+        y1 /= height;
+        y2 /= height;
         // TextOutputDev is upside down device
         y1 = 1 - y1;
         y2 = 1 - y2;
@@ -286,91 +379,460 @@ NAN_METHOD(NodePopplerPage::getWordList)
         y2 = y1 - y2;
         y1 = y1 - y2;
 
-        Nan::Set(v8result, Nan::New("x1", 2).ToLocalChecked(), Nan::New<Number>(x1));
-        Nan::Set(v8result, Nan::New("x2", 2).ToLocalChecked(), Nan::New<Number>(x2));
-        Nan::Set(v8result, Nan::New("y1", 2).ToLocalChecked(), Nan::New<Number>(y1));
-        Nan::Set(v8result, Nan::New("y2", 2).ToLocalChecked(), Nan::New<Number>(y2));
+        box.x1 = x1;
+        box.x2 = x2;
+        box.y1 = y1;
+        box.y2 = y2;
 #if POPPLER_VERSION_MAJOR == 0 && POPPLER_VERSION_MINOR < 72
-        auto c_str = str->getCString();
+        box.text = str->getCString();
 #else
-        auto c_str = str->c_str();
+        box.text = str->c_str();
 #endif
-        Nan::Set(v8result, Nan::New("text", 4).ToLocalChecked(), Nan::New(c_str).ToLocalChecked());
-        Nan::Set(v8results, i, v8result);
-
         delete str;
     }
 
 #if (POPPLER_VERSION_MAJOR == 21 && POPPLER_VERSION_MINOR < 11) || POPPLER_VERSION_MAJOR < 21
     delete wordList;
 #endif
+}
+
+/**
+     * Searches the page for `len` UCS-4 characters. Runs on any thread.
+     */
+void NodePopplerPage::collectMatches(const unsigned int *ucs4, int len, std::vector<TextBox> &boxes)
+{
+    double xMin = 0, yMin = 0, xMax, yMax;
+    // TextPage keeps the position of the last match, so searches are serialised too
+    std::lock_guard<std::mutex> guard(parent->renderContexts->sharedLock());
+    TextPage *text = getTextPage(false);
+
+    while (text->findText((unsigned int *)ucs4, len,
+                          false, true,  // startAtTop, stopAtBottom
+                          false, false, // startAtLast, stopAtLast
+                          false, false, // caseSensitive, backwards
+                          false, // wholeWord
+                          &xMin, &yMin, &xMax, &yMax))
+    {
+        TextBox box;
+        box.x1 = xMin / getWidth();
+        box.x2 = xMax / getWidth();
+        box.y1 = (getHeight() - yMax) / getHeight();
+        box.y2 = (getHeight() - yMin) / getHeight();
+        boxes.push_back(box);
+    }
+    text->decRefCnt();
+}
+
+/**
+     * Searches the page for many case folded terms at once: one Aho-Corasick
+     * pass over the page text instead of a TextPage::findText scan per term.
+     * Like findText, matches of a term don't overlap and don't span lines.
+     * Runs on any thread.
+     */
+void NodePopplerPage::collectMatches(const std::vector<std::vector<Unicode>> &terms, std::vector<std::vector<TextBox>> &groups)
+{
+    const Unicode LINE_BREAK = 0xffffffff;
+    AhoCorasick matcher;
+    for (const std::vector<Unicode> &term : terms)
+    {
+        matcher.add(term.data(), term.size());
+    }
+    matcher.build();
+
+    // Page text in reading order, with a space between words of a line where
+    // there is one, and the box of every code point (none for spaces)
+    std::vector<Unicode> chars;
+    std::vector<TextBox> charBoxes;
+    {
+        std::lock_guard<std::mutex> guard(parent->renderContexts->sharedLock());
+        TextPage *text = getTextPage(false);
+        auto wordList = text->makeWordList(true);
+        int l = wordList->getLength();
+        for (int i = 0; i < l; i++)
+        {
+            TextWord *word = wordList->get(i);
+            for (int c = 0; c < word->getLength(); c++)
+            {
+                TextBox box;
+                word->getCharBBox(c, &box.x1, &box.y1, &box.x2, &box.y2);
+                chars.push_back(unicodeToUpper(word->getChar(c)[0]));
+                charBoxes.push_back(box);
+            }
+            if (i + 1 < l)
+            {
+                TextBox none = {1, 1, 0, 0, std::string()};
+                if (word->nextWord() != wordList->get(i + 1))
+                {
+                    chars.push_back(LINE_BREAK);
+                    charBoxes.push_back(none);
+                }
+                else if (word->hasSpaceAfter())
+                {
+                    chars.push_back(' ');
+                    charBoxes.push_back(none);
+                }
+            }
+        }
+#if (POPPLER_VERSION_MAJOR == 21 && POPPLER_VERSION_MINOR < 11) || POPPLER_VERSION_MAJOR < 21
+        delete wordList;
+#endif
+        text->decRefCnt();
+    }
+
+    groups.assign(terms.size(), std::vector<TextBox>());
+    // end of the last match of each term
+    std::vector<size_t> lastEnd(terms.size(), 0);
+    std::vector<size_t> found;
+    int state = AhoCorasick::ROOT;
+    for (size_t i = 0; i < chars.size(); i++)
+    {
+        if (chars[i] == LINE_BREAK)
+        {
+            state = AhoCorasick::ROOT;
+            continue;
+        }
+        state = matcher.step(state, chars[i]);
+        found.clear();
+        matcher.matches(state, found);
+        for (size_t term : found)
+        {
+            size_t start = i + 1 - matcher.patternLength(term);
+            if (start < lastEnd[term])
+                continue;
+            lastEnd[term] = i + 1;
+
+            double xMin = 0, yMin = 0, xMax = 0, yMax = 0;
+            bool empty = true;
+            for (size_t k = start; k <= i; k++)
+            {
+                const TextBox &box = charBoxes[k];
+                if (box.x1 > box.x2)
+                    continue;
+                xMin = empty ? box.x1 : std::min(xMin, box.x1);
+                yMin = empty ? box.y1 : std::min(yMin, box.y1);
+                xMax = empty ? box.x2 : std::max(xMax, box.x2);
+                yMax = empty ? box.y2 : std::max(yMax, box.y2);
+                empty = false;
+            }
+            if (empty)
+                continue;
+            TextBox match;
+            match.x1 = xMin / getWidth();
+            match.x2 = xMax / getWidth();
+            match.y1 = (getHeight() - yMax) / getHeight();
+            match.y2 = (getHeight() - yMin) / getHeight();
+            groups[term].push_back(match);
+        }
+    }
+}
+
+/**
+     * Converts text boxes of a finished TextWork to JS values
+     */
+Local<Value> NodePopplerPage::textResult(TextWork *work)
+{
+    Nan::EscapableHandleScope scope;
+    if (work->kind == TextWork::TW_LOAD)
+    {
+        return scope.Escape(Nan::Null());
+    }
+    if (work->columnar)
+    {
+        return scope.Escape(columnarResult(work));
+    }
+    if (work->kind == TextWork::TW_FIND_MANY)
+    {
+        Local<v8::Array> v8groups = Nan::New<v8::Array>(work->groups.size());
+        for (size_t g = 0; g < work->groups.size(); g++)
+        {
+            Nan::Set(v8groups, g, boxesResult(work->groups[g], false));
+        }
+        return scope.Escape(v8groups);
+    }
+    return scope.Escape(boxesResult(work->boxes, work->kind == TextWork::TW_WORDS));
+}
+
+Local<v8::Array> NodePopplerPage::boxesResult(const std::vector<TextBox> &boxes, bool withText)
+{
+    Nan::EscapableHandleScope scope;
+    Local<v8::Array> v8results = Nan::New<v8::Array>(boxes.size());
+    for (size_t i = 0; i < boxes.size(); i++)
+    {
+        const TextBox &box = boxes[i];
+        Local<v8::Object> v8result = Nan::New<v8::Object>();
+        Nan::Set(v8result, Nan::New("x1", 2).ToLocalChecked(), Nan::New<Number>(box.x1));
+        Nan::Set(v8result, Nan::New("x2", 2).ToLocalChecked(), Nan::New<Number>(box.x2));
+        Nan::Set(v8result, Nan::New("y1", 2).ToLocalChecked(), Nan::New<Number>(box.y1));
+        Nan::Set(v8result, Nan::New("y2", 2).ToLocalChecked(), Nan::New<Number>(box.y2));
+        if (withText)
+        {
+            Nan::Set(v8result, Nan::New("text", 4).ToLocalChecked(), Nan::New(box.text).ToLocalChecked());
+        }
+        Nan::Set(v8results, i, v8result);
+    }
+    return scope.Escape(v8results);
+}
+
+/**
+     * Packs words into three allocations: `bboxes` Float64Array of x1, y1, x2, y2
+     * per word, `offsets` Uint32Array where word i is text[offsets[i]..offsets[i + 1]],
+     * and `text` Buffer with all words in UTF-8
+     */
+Local<v8::Object> NodePopplerPage::columnarResult(TextWork *work)
+{
+    Nan::EscapableHandleScope scope;
+    size_t n = work->boxes.size();
+    size_t textLen = 0;
+    for (const TextBox &box : work->boxes)
+    {
+        textLen += box.text.length();
+    }
+
+    Local<v8::ArrayBuffer> bboxesBuf = v8::ArrayBuffer::New(v8::Isolate::GetCurrent(), n * 4 * sizeof(double));
+    Local<v8::ArrayBuffer> offsetsBuf = v8::ArrayBuffer::New(v8::Isolate::GetCurrent(), (n + 1) * sizeof(uint32_t));
+    Local<v8::Float64Array> bboxes = v8::Float64Array::New(bboxesBuf, 0, n * 4);
+    Local<v8::Uint32Array> offsets = v8::Uint32Array::New(offsetsBuf, 0, n + 1);
+    double *b = *Nan::TypedArrayContents<double>(bboxes);
+    uint32_t *o = *Nan::TypedArrayContents<uint32_t>(offsets);
+    // Buffer takes ownership, one extra byte keeps malloc(0) out of the way
+    char *text = (char *)malloc(textLen + 1);
+
+    size_t pos = 0;
+    for (size_t i = 0; i < n; i++)
+    {
+        const TextBox &box = work->boxes[i];
+        b[i * 4] = box.x1;
+        b[i * 4 + 1] = box.y1;
+        b[i * 4 + 2] = box.x2;
+        b[i * 4 + 3] = box.y2;
+        o[i] = pos;
+        memcpy(text + pos, box.text.data(), box.text.length());
+        pos += box.text.length();
+    }
+    o[n] = pos;
+
+    Local<v8::Object> out = Nan::New<v8::Object>();
+    Nan::Set(out, Nan::New("bboxes").ToLocalChecked(), bboxes);
+    Nan::Set(out, Nan::New("offsets").ToLocalChecked(), offsets);
+    Nan::Set(out, Nan::New("text").ToLocalChecked(), Nan::NewBuffer(text, textLen).ToLocalChecked());
+    return scope.Escape(out);
+}
+
+void NodePopplerPage::runText(TextWork *work)
+{
+    switch (work->kind)
+    {
+    case TextWork::TW_LOAD:
+    {
+        std::lock_guard<std::mutex> guard(work->self->parent->renderContexts->sharedLock());
+        work->self->getTextPage(work->rawOrder)->decRefCnt();
+    }
+    break;
+    case TextWork::TW_WORDS:
+        work->self->collectWords(work->rawOrder, work->boxes);
+        break;
+    case TextWork::TW_FIND:
+        work->self->collectMatches((unsigned int *)work->ucs4, work->ucs4_len / 4 - 1, work->boxes);
+        break;
+    case TextWork::TW_FIND_MANY:
+        work->self->collectMatches(work->terms, work->groups);
+        break;
+    }
+}
+
+/**
+     * Runs text layout on a render thread, or synchronously without a callback
+     */
+void NodePopplerPage::queueText(TextWork *work, Local<v8::Object> pageHandle)
+{
+    // keep the page and its document alive until the work is done
+    work->pageHandle.Reset(pageHandle);
+    work->docHandle.Reset(parent->handle());
+    RenderPool::queue(&work->request, AsyncTextWork, AsyncTextAfter);
+}
+
+void NodePopplerPage::AsyncTextWork(uv_work_t *req)
+{
+    TextWork *work = static_cast<TextWork *>(req->data);
+    runText(work);
+}
+
+void NodePopplerPage::AsyncTextAfter(uv_work_t *req, int status)
+{
+    Nan::HandleScope scope;
+    TextWork *work = static_cast<TextWork *>(req->data);
+    Local<Value> argv[] = {Nan::Null(), textResult(work)};
+    Nan::TryCatch try_catch;
+    Nan::AsyncResource res(Nan::New("poppler-simple::text").ToLocalChecked());
+    work->callback->Call(2, argv, &res);
+    if (try_catch.HasCaught())
+    {
+        Nan::FatalException(try_catch);
+    }
+    delete work;
+}
+
+/**
+     * \return Object Array of Objects which represents individual words on page
+     *                and stores word text and relative coords
+     *
+     * \param options Boolean|Object optional, `rawOrder` flag or
+     *                {rawOrder: Boolean, format: 'objects'|'columnar'}
+     * \param callback Function optional, extract words on a worker thread
+     */
+NAN_METHOD(NodePopplerPage::getWordList)
+{
+    Nan::HandleScope scope;
+    NodePopplerPage *self = Nan::ObjectWrap::Unwrap<NodePopplerPage>(info.Holder());
+
+    bool rawOrder = info[0]->IsBoolean() ? (To<bool>(info[0]).FromMaybe(false) ? true : false) : false;
+    bool columnar = false;
+    if (info[0]->IsObject() && !info[0]->IsFunction())
+    {
+        Local<v8::Object> options = info[0].As<v8::Object>();
+        Local<Value> rv = Nan::Get(options, Nan::New("rawOrder").ToLocalChecked()).ToLocalChecked();
+        rawOrder = rv->IsBoolean() && To<bool>(rv).FromMaybe(false);
+        Local<Value> fv = Nan::Get(options, Nan::New("format").ToLocalChecked()).ToLocalChecked();
+        Nan::Utf8String format(fv);
+        if (fv->IsString() && strcmp(*format, "columnar") == 0)
+        {
+            columnar = true;
+        }
+        else if (!fv->IsUndefined() && !(fv->IsString() && strcmp(*format, "objects") == 0))
+        {
+            return Nan::ThrowError("'format' option value must be 'objects' or 'columnar'");
+        }
+    }
+
+    if (self->isDocClosed())
+    {
+        return Nan::ThrowError("Document closed. You must delete this page");
+    }
+
+    TextWork *work = new TextWork(self, TextWork::TW_WORDS);
+    work->rawOrder = rawOrder;
+    work->columnar = columnar;
+    if (info.Length() > 0 && info[info.Length() - 1]->IsFunction())
+    {
+        work->callback = new Nan::Callback(info[info.Length() - 1].As<v8::Function>());
+        return self->queueText(work, info.Holder());
+    }
+    if (self->parent->isStreamed())
+    {
+        delete work;
+        return Nan::ThrowError(STREAMED_SYNC_ERROR);
+    }
 
+    runText(work);
+    Local<Value> v8results = textResult(work);
+    delete work;
     info.GetReturnValue().Set(v8results);
 }
 
 /**
-     * \return Object Relative coors from lower left corner
+     * \return Object Relative coors from lower left corner, or an Array of them
+     *                per term if `str` is an Array
+     *
+     * \param str String|Array text to search, or many texts searched in one pass
+     * \param callback Function optional, search on a worker thread
      */
 NAN_METHOD(NodePopplerPage::findText)
 {
     Nan::HandleScope scope;
     NodePopplerPage *self = Nan::ObjectWrap::Unwrap<NodePopplerPage>(info.Holder());
-    TextPage *text;
-    char *ucs4 = NULL;
-    size_t ucs4_len;
-    double xMin = 0, yMin = 0, xMax, yMax;
-    PDFRectangle **matches = NULL;
-    unsigned int cnt = 0;
 
     if (self->isDocClosed())
     {
         return Nan::ThrowError("Document closed. You must delete this page");
     }
 
-    if (info.Length() != 1 && !info[0]->IsString())
+    bool async = info.Length() > 1 && info[info.Length() - 1]->IsFunction();
+    int argc = async ? info.Length() - 1 : info.Length();
+    if (argc != 1 && !info[0]->IsString())
     {
         return Nan::ThrowError("One argument required: (str: String)");
     }
-    Nan::Utf8String str(info[0]);
-
-    iconv_string("UCS-4LE", "UTF-8", *str, *str + strlen(*str) + 1, &ucs4, &ucs4_len);
-    text = self->getTextPage(false);
-
-    while (text->findText((unsigned int *)ucs4, ucs4_len / 4 - 1,
-                          false, true,  // startAtTop, stopAtBottom
-                          false, false, // startAtLast, stopAtLast
-                          false, false, // caseSensitive, backwards
-                          false, // wholeWord
-                          &xMin, &yMin, &xMax, &yMax))
+    TextWork *work;
+    if (info[0]->IsArray())
     {
-        PDFRectangle **t_matches = matches;
-        cnt++;
-        matches = (PDFRectangle **)realloc(t_matches, sizeof(PDFRectangle *) * cnt);
-        matches[cnt - 1] = new PDFRectangle(xMin, self->getHeight() - yMax, xMax, self->getHeight() - yMin);
+        Local<v8::Array> terms = info[0].As<v8::Array>();
+        work = new TextWork(self, TextWork::TW_FIND_MANY);
+        work->terms.resize(terms->Length());
+        for (uint32_t i = 0; i < terms->Length(); i++)
+        {
+            Local<Value> term = Nan::Get(terms, i).ToLocalChecked();
+            if (!term->IsString())
+            {
+                delete work;
+                return Nan::ThrowError("Search terms must be strings");
+            }
+            Nan::Utf8String termStr(term);
+            char *ucs4 = NULL;
+            size_t ucs4_len = 0;
+            iconv_string("UCS-4LE", "UTF-8", *termStr, *termStr + termStr.length(), &ucs4, &ucs4_len);
+            for (size_t c = 0; c < ucs4_len / 4; c++)
+            {
+                work->terms[i].push_back(unicodeToUpper(((unsigned int *)ucs4)[c]));
+            }
+            if (ucs4 != NULL)
+                free(ucs4);
+        }
     }
-    Local<v8::Array> v8results = Nan::New<v8::Array>(cnt);
-    for (unsigned int i = 0; i < cnt; i++)
+    else
     {
-        PDFRectangle *match = matches[i];
-        Local<v8::Object> v8result = Nan::New<v8::Object>();
-        Nan::Set(v8result, Nan::New("x1").ToLocalChecked(), Nan::New<Number>(match->x1 / self->getWidth()));
-        Nan::Set(v8result, Nan::New("x2").ToLocalChecked(), Nan::New<Number>(match->x2 / self->getWidth()));
-        Nan::Set(v8result, Nan::New("y1").ToLocalChecked(), Nan::New<Number>(match->y1 / self->getHeight()));
-        Nan::Set(v8result, Nan::New("y2").ToLocalChecked(), Nan::New<Number>(match->y2 / self->getHeight()));
-        Nan::Set(v8results, i, v8result);
-        delete match;
+        Nan::Utf8String str(info[0]);
+        work = new TextWork(self, TextWork::TW_FIND);
+        iconv_string("UCS-4LE", "UTF-8", *str, *str + strlen(*str) + 1, &work->ucs4, &work->ucs4_len);
     }
-    if (ucs4 != NULL)
+    if (async)
     {
-        free(ucs4);
+        work->callback = new Nan::Callback(info[info.Length() - 1].As<v8::Function>());
+        return self->queueText(work, info.Holder());
     }
-    if (matches != NULL)
+    if (self->parent->isStreamed())
     {
-        free(matches);
+        delete work;
+        return Nan::ThrowError(STREAMED_SYNC_ERROR);
     }
+
+    runText(work);
+    Local<Value> v8results = textResult(work);
+    delete work;
     info.GetReturnValue().Set(v8results);
 }
 
+/**
+     * Builds the text layout of the page on a worker thread, so later
+     * getWordList and findText calls don't block
+     *
+     * \param rawOrder Boolean optional, \see NodePopplerPage::getWordList
+     * \param callback Function
+     */
+NAN_METHOD(NodePopplerPage::loadText)
+{
+    Nan::HandleScope scope;
+    NodePopplerPage *self = Nan::ObjectWrap::Unwrap<NodePopplerPage>(info.Holder());
+
+    if (info.Length() < 1 || !info[info.Length() - 1]->IsFunction())
+    {
+        return Nan::ThrowError("Arguments: ([rawOrder: Boolean, ]callback: Function)");
+    }
+    Nan::Callback *callback = new Nan::Callback(info[info.Length() - 1].As<v8::Function>());
+
+    if (self->isDocClosed())
+    {
+        Local<Value> argv[] = {Nan::Error("Document closed. You must delete this page")};
+        Nan::Call(*callback, 1, argv);
+        delete callback;
+        return;
+    }
+
+    TextWork *work = new TextWork(self, TextWork::TW_LOAD);
+    work->rawOrder = info[0]->IsBoolean() && To<bool>(info[0]).FromMaybe(false);
+    work->callback = callback;
+    self->queueText(work, info.Holder());
+}
+
 /**
 * Deletes typeHighlight annotations from end of an annotations array
 */
@@ -379,6 +841,18 @@ NAN_METHOD(NodePopplerPage::deleteAnnots)
     Nan::HandleScope scope;
     NodePopplerPage *self = Nan::ObjectWrap::Unwrap<NodePopplerPage>(info.Holder());
 
+    if (self->isDocClosed())
+    {
+        return Nan::ThrowError("Document closed. You must delete this page");
+    }
+    if (self->parent->isStreamed())
+    {
+        return Nan::ThrowError(STREAMED_SYNC_ERROR);
+    }
+
+    std::lock_guard<std::mutex> guard(self->parent->renderContexts->sharedLock());
+    // renders must see the change, so they switch to the shared document
+    self->parent->renderContexts->invalidate();
     while (true)
     {
         Annots *annots = self->pg->getAnnots();
@@ -428,6 +902,14 @@ NAN_METHOD(NodePopplerPage::addAnnot)
     {
         return Nan::ThrowError("One argument required: (annot: Object | Array).");
     }
+    if (self->parent->isStreamed())
+    {
+        return Nan::ThrowError(STREAMED_SYNC_ERROR);
+    }
+
+    std::lock_guard<std::mutex> guard(self->parent->renderContexts->sharedLock());
+    // renders must see the change, so they switch to the shared document
+    self->parent->renderContexts->invalidate();
 
     if (info[0]->IsArray())
     {
@@ -593,64 +1075,185 @@ void NodePopplerPage::parseAnnot(const Local<Value> rect,
      */
 void NodePopplerPage::display(RenderWork *work)
 {
-    SplashColor paperColor;
-    paperColor[0] = 255;
-    paperColor[1] = 255;
-    paperColor[2] = 255;
-    SplashOutputDev *splashOut = new SplashOutputDev(
-        splashModeRGB8,
-        4, false,
-        paperColor);
-    splashOut->startDoc(work->self->doc);
-    ImgWriter *writer = NULL;
-    switch (work->w)
-    {
-    case W_PNG:
-        writer = new PNGWriter();
-        break;
-    case W_JPEG:
-        writer = new JpegWriter(work->quality, work->progressive);
-        break;
-    case W_TIFF:
-        writer = new TiffWriter(TiffWriter::RGB);
-        if (work->compression != NULL)
-        {
-            ((TiffWriter *)writer)->setCompressionString(work->compression);
-        }
-    }
     int sx, sy, sw, sh;
     std::tie(sx, sy, sw, sh) = work->applyScale();
     if (work->error)
         return;
-    work->self->pg->displaySlice(splashOut, work->PPI, work->PPI,
-                                 0, false, true,
-                                 sx, sy, sw, sh,
-                                 false);
-
-    SplashBitmap *bitmap = splashOut->getBitmap();
-#if POPPLER_VERSION_MAJOR > 0 || (POPPLER_VERSION_MAJOR == 0 && POPPLER_VERSION_MINOR > 49)
-    SplashError e = bitmap->writeImgFile(writer, work->f, (int)work->PPI, (int)work->PPI, splashModeRGB8);
-#else
-    SplashError e = bitmap->writeImgFile(writer, work->f, (int)work->PPI, (int)work->PPI);
-#endif
-    delete splashOut;
-    if (writer != NULL)
-        delete writer;
-
-    if (e
-    )
+    SplashColorMode mode = work->splashMode();
+    if (work->shouldAbort())
     {
-        char err[256];
-        sprintf(err, "SplashError %d", e);
-        work->error = new char[strlen(err) + 1];
-        strcpy(work->error, err);
+        // cancelled while waiting for a worker
+        work->setAbortError();
+        return;
     }
-}
-
-/**
-     * Renders page to a file stream
-     *
-     * Backend function for \see NodePopplerPage::renderToBuffer and \see NodePopplerPage::renderToFile
+    RenderContextPool *contexts = work->self->parent->renderContexts.get();
+    std::string key;
+    if (work->cacheable())
+    {
+        key = work->cacheKey();
+        // taken over by closeStream() instead of the stream's data
+        work->mstrm_buf = RenderCache::get(key, &work->mstrm_len);
+        if (work->mstrm_buf != NULL)
+        {
+            return;
+        }
+    }
+    // reads of a streamed document give up with the render
+    RangeLoader::AbortScope abortScope([work]() { return work->shouldAbort(); });
+    RenderContextPool::Context *ctx = contexts->acquire(mode, work->paper);
+    SplashOutputDev *splashOut = ctx->out;
+    ImgWriter *writer = work->makeWriter();
+    if (work->onPreview != NULL)
+    {
+        // the page, its resources and fonts stay loaded in ctx for the final pass
+        displayPreview(work, ctx);
+        if (work->error || work->errorCode)
+        {
+            contexts->release(ctx);
+            if (writer != NULL)
+                delete writer;
+            if (!work->error)
+                work->setAbortError();
+            return;
+        }
+    }
+    // render through the context's own copy of the document
+    Page *page = ctx->doc->getPage(work->self->getNum());
+    if (page == NULL)
+    {
+        contexts->release(ctx);
+        if (writer != NULL)
+            delete writer;
+        work->error = new char[strlen(PAGE_READ_ERROR) + 1];
+        strcpy(work->error, PAGE_READ_ERROR);
+        return;
+    }
+    page->displaySlice(splashOut, work->PPI, work->PPI,
+                       0, false, true,
+                       sx, sy, sw, sh,
+                       false, abortCheck, work);
+
+    if (work->errorCode)
+    {
+        contexts->release(ctx);
+        if (writer != NULL)
+            delete writer;
+        work->setAbortError();
+        return;
+    }
+
+    if (work->w == W_RAW)
+    {
+        work->takePixels(splashOut->getBitmap());
+        contexts->release(ctx);
+        return;
+    }
+
+    SplashBitmap *bitmap = splashOut->getBitmap();
+    SplashError e = splashOk;
+    if (work->transparent || work->colorMode != CM_RGB)
+    {
+        // writeImgFile drops the alpha channel and older poppler only writes RGB
+        // rows; tiles and bands pack gray and mono rows the same way
+        if (!work->writeRegion(writer, work->f, bitmap, 0, 0, bitmap->getWidth(), bitmap->getHeight()))
+            e = splashErrGeneric;
+    }
+    else
+    {
+#if POPPLER_VERSION_MAJOR > 0 || (POPPLER_VERSION_MAJOR == 0 && POPPLER_VERSION_MINOR > 49)
+        e = bitmap->writeImgFile(writer, work->f, (int)work->PPI, (int)work->PPI, mode);
+#else
+        e = bitmap->writeImgFile(writer, work->f, (int)work->PPI, (int)work->PPI);
+#endif
+    }
+    contexts->release(ctx);
+    if (writer != NULL)
+        delete writer;
+
+    if (e)
+    {
+        char err[256];
+        sprintf(err, "SplashError %d", e);
+        work->error = new char[strlen(err) + 1];
+        strcpy(work->error, err);
+    }
+    else if (!key.empty() && fflush(work->f) == 0)
+    {
+        RenderCache::put(key, work->stream->getBuffer(), work->stream->getBufferLen());
+    }
+}
+
+/**
+     * Renders the slice at preview resolution without vector antialiasing
+     * and posts it to the main thread
+     */
+void NodePopplerPage::displayPreview(RenderWork *work, RenderContextPool::Context *ctx)
+{
+    int sx, sy, sw, sh;
+    std::tie(sx, sy, sw, sh) = work->applyScale(work->previewPPI);
+    Page *page = ctx->doc->getPage(work->self->getNum());
+    if (page == NULL)
+    {
+        work->error = new char[strlen(PAGE_READ_ERROR) + 1];
+        strcpy(work->error, PAGE_READ_ERROR);
+        return;
+    }
+    bool antialias = ctx->out->getVectorAntialias();
+    ctx->out->setVectorAntialias(false);
+    page->displaySlice(ctx->out, work->previewPPI, work->previewPPI,
+                       0, false, true,
+                       sx, sy, sw, sh,
+                       false, abortCheck, work);
+    ctx->out->setVectorAntialias(antialias);
+    if (work->errorCode)
+    {
+        return;
+    }
+
+    SplashBitmap *bitmap = ctx->out->getBitmap();
+    int width = bitmap->getWidth();
+    int height = bitmap->getHeight();
+    size_t len;
+    char *data = work->encodeRegion(bitmap, 0, 0, width, height, &len);
+    if (data == NULL)
+    {
+        return;
+    }
+    work->progress->post([work, width, height, data, len]() {
+        Local<v8::Object> out = Nan::New<v8::Object>();
+        Nan::Set(out, Nan::New("type").ToLocalChecked(), Nan::New("buffer").ToLocalChecked());
+        Nan::Set(out, Nan::New("format").ToLocalChecked(), Nan::New(work->format).ToLocalChecked());
+        Nan::Set(out, Nan::New("data").ToLocalChecked(), Nan::NewBuffer(data, len).ToLocalChecked());
+        Nan::Set(out, Nan::New("PPI").ToLocalChecked(), Nan::New<Number>(work->previewPPI));
+        Nan::Set(out, Nan::New("width").ToLocalChecked(), Nan::New<Uint32>(width));
+        Nan::Set(out, Nan::New("height").ToLocalChecked(), Nan::New<Uint32>(height));
+        Local<Value> argv[] = {out};
+        Nan::TryCatch try_catch;
+        Nan::AsyncResource res(Nan::New("poppler-simple::render-preview").ToLocalChecked());
+        work->onPreview->Call(1, argv, &res);
+        if (try_catch.HasCaught())
+        {
+            Nan::FatalException(try_catch);
+        }
+    });
+}
+
+/**
+     * Polled by poppler between content stream operators
+     */
+#if POPPLER_VERSION_MAJOR == 0 && POPPLER_VERSION_MINOR < 71
+GBool NodePopplerPage::abortCheck(void *data)
+#else
+bool NodePopplerPage::abortCheck(void *data)
+#endif
+{
+    return static_cast<RenderWork *>(data)->shouldAbort();
+}
+
+/**
+     * Renders page to a file stream
+     *
+     * Backend function for \see NodePopplerPage::renderToBuffer and \see NodePopplerPage::renderToFile
      */
 void NodePopplerPage::renderToStream(RenderWork *work)
 {
@@ -660,7 +1263,9 @@ void NodePopplerPage::renderToStream(RenderWork *work)
     }
     else
     {
-        uv_queue_work(uv_default_loop(), &work->request, AsyncRenderWork, AsyncRenderAfter);
+        // The document owns the render contexts, keep it alive until the work is done
+        work->docHandle.Reset(parent->handle());
+        RenderPool::queue(&work->request, AsyncRenderWork, AsyncRenderAfter, work->priority);
     }
 }
 
@@ -676,10 +1281,16 @@ void NodePopplerPage::AsyncRenderAfter(uv_work_t *req, int status)
     RenderWork *work = static_cast<RenderWork *>(req->data);
 
     work->closeStream();
+    if (work->progress != NULL)
+    {
+        // the preview goes out before the final image
+        work->progress->close();
+        work->progress = NULL;
+    }
 
     if (work->error)
     {
-        Local<Value> err = Nan::Error(work->error);
+        Local<Value> err = renderError(work->error, work->errorCode);
         Local<Value> argv[] = {err};
         Nan::TryCatch try_catch;
         Nan::Call(*work->callback, 1, argv);
@@ -688,6 +1299,18 @@ void NodePopplerPage::AsyncRenderAfter(uv_work_t *req, int status)
             Nan::FatalException(try_catch);
         }
     }
+    else if (work->onChunk != NULL)
+    {
+        // the image went out in chunks
+        Local<Value> argv[] = {Nan::Null()};
+        Nan::TryCatch try_catch;
+        Nan::AsyncResource res(Nan::New("poppler-simple::render-bands").ToLocalChecked());
+        work->callback->Call(1, argv, &res);
+        if (try_catch.HasCaught())
+        {
+            Nan::FatalException(try_catch);
+        }
+    }
     else
     {
         switch (work->dest)
@@ -709,14 +1332,7 @@ void NodePopplerPage::AsyncRenderAfter(uv_work_t *req, int status)
         }
         case DEST_BUFFER:
         {
-            Local<v8::Object> buffer = Nan::NewBuffer(work->mstrm_len)
-                                           .ToLocalChecked();
-            Local<v8::Object> out = Nan::New<v8::Object>();
-            memcpy(Buffer::Data(buffer), work->mstrm_buf, work->mstrm_len);
-            Nan::Set(out, Nan::New("type").ToLocalChecked(), Nan::New("buffer").ToLocalChecked());
-            Nan::Set(out, Nan::New("format").ToLocalChecked(), Nan::New(work->format).ToLocalChecked());
-            Nan::Set(out, Nan::New("data").ToLocalChecked(), buffer);
-            Local<Value> argv[] = {Nan::Null(), out};
+            Local<Value> argv[] = {Nan::Null(), bufferResult(work)};
             Nan::TryCatch try_catch;
             Nan::AsyncResource res(Nan::New("poppler-simple::render-to-buffer").ToLocalChecked());
             work->callback->Call(2, argv, &res);
@@ -732,6 +1348,45 @@ void NodePopplerPage::AsyncRenderAfter(uv_work_t *req, int status)
     delete work;
 }
 
+/**
+     * Builds the result object of a buffer render
+     */
+Local<v8::Object> NodePopplerPage::bufferResult(RenderWork *work)
+{
+    Nan::EscapableHandleScope scope;
+    // Buffer takes ownership of the malloc'ed output, so it is never copied
+    Local<v8::Object> buffer = Nan::NewBuffer(work->mstrm_buf, work->mstrm_len).ToLocalChecked();
+    work->mstrm_buf = NULL;
+    Local<v8::Object> out = Nan::New<v8::Object>();
+
+    Nan::Set(out, Nan::New("type").ToLocalChecked(), Nan::New("buffer").ToLocalChecked());
+    Nan::Set(out, Nan::New("format").ToLocalChecked(), Nan::New(work->format).ToLocalChecked());
+    Nan::Set(out, Nan::New("data").ToLocalChecked(), buffer);
+    if (work->w == W_RAW)
+    {
+        const char *colorModes[] = {"rgb", "rgba", "gray"};
+        Nan::Set(out, Nan::New("width").ToLocalChecked(), Nan::New<Uint32>(work->raw_width));
+        Nan::Set(out, Nan::New("height").ToLocalChecked(), Nan::New<Uint32>(work->raw_height));
+        Nan::Set(out, Nan::New("stride").ToLocalChecked(), Nan::New<Uint32>(work->raw_stride));
+        Nan::Set(out, Nan::New("colorMode").ToLocalChecked(), Nan::New(colorModes[work->colorMode]).ToLocalChecked());
+    }
+    return scope.Escape(out);
+}
+
+/**
+     * Creates an Error, with `code` set for cancelled renders
+     */
+Local<Value> NodePopplerPage::renderError(const char *message, const char *code)
+{
+    Nan::EscapableHandleScope scope;
+    Local<Value> err = Nan::Error(message);
+    if (code)
+    {
+        Nan::Set(err.As<v8::Object>(), Nan::New("code").ToLocalChecked(), Nan::New(code).ToLocalChecked());
+    }
+    return scope.Escape(err);
+}
+
 /**
      * Renders page to a Buffer
      *
@@ -765,6 +1420,11 @@ NAN_METHOD(NodePopplerPage::renderToBuffer)
         Local<Value> err = Nan::Error("Document closed. You must delete this page");
         THROW_SYNC_ASYNC_ERR(work, err);
     }
+    if (work->callback == NULL && self->parent->isStreamed())
+    {
+        Local<Value> err = Nan::Error(STREAMED_SYNC_ERROR);
+        THROW_SYNC_ASYNC_ERR(work, err);
+    }
 
     work->setWriter(info[0]);
     if (work->error)
@@ -808,21 +1468,13 @@ NAN_METHOD(NodePopplerPage::renderToBuffer)
 
         if (work->error)
         {
-            Local<Value> e = Nan::Error(work->error);
+            Local<Value> e = renderError(work->error, work->errorCode);
             delete work;
             return Nan::ThrowError(e);
         }
         else
         {
-            Local<v8::Object> buffer = Nan::NewBuffer(work->mstrm_len).ToLocalChecked();
-            Local<v8::Object> out = Nan::New<v8::Object>();
-
-            memcpy(Buffer::Data(buffer), work->mstrm_buf, work->mstrm_len);
-
-            Nan::Set(out, Nan::New("type").ToLocalChecked(), Nan::New("buffer").ToLocalChecked());
-            Nan::Set(out, Nan::New("format").ToLocalChecked(), info[0]);
-            Nan::Set(out, Nan::New("data").ToLocalChecked(), buffer);
-
+            Local<v8::Object> out = bufferResult(work);
             delete work;
             info.GetReturnValue().Set(out);
         }
@@ -876,6 +1528,11 @@ NAN_METHOD(NodePopplerPage::renderToFile)
         Local<Value> err = Nan::Error("Document closed. You must delete this page");
         THROW_SYNC_ASYNC_ERR(work, err);
     }
+    if (work->callback == NULL && self->parent->isStreamed())
+    {
+        Local<Value> err = Nan::Error(STREAMED_SYNC_ERROR);
+        THROW_SYNC_ASYNC_ERR(work, err);
+    }
 
     work->setPath(info[0]);
     if (work->error)
@@ -915,30 +1572,599 @@ NAN_METHOD(NodePopplerPage::renderToFile)
         THROW_SYNC_ASYNC_ERR(work, err);
     }
 
-    self->renderToStream(work);
-    if (work->callback != NULL)
+    self->renderToStream(work);
+    if (work->callback != NULL)
+    {
+        return;
+    }
+    else
+    {
+        work->closeStream();
+        if (work->error)
+        {
+            Local<Value> e = renderError(work->error, work->errorCode);
+            unlink(work->filename);
+            delete work;
+            return Nan::ThrowError(e);
+        }
+        else
+        {
+            Local<v8::Object> out = Nan::New<v8::Object>();
+            Nan::Set(out, Nan::New("type").ToLocalChecked(), Nan::New("file").ToLocalChecked());
+            Nan::Set(out, Nan::New("path").ToLocalChecked(), Nan::New(work->filename).ToLocalChecked());
+            delete work;
+            info.GetReturnValue().Set(out);
+        }
+    }
+}
+
+/**
+     * Renders tiles of the page
+     *
+     * Javascript function
+     *
+     * \param method String \see NodePopplerPage::renderToFile
+     * \param PPI Number \see NodePopplerPage::renderToFile
+     * \param options Object \see NodePopplerPage::renderToFile, without `slice`, plus:
+     *   tiles: Array - tiles to render, as {x: Number, y: Number} column and row
+     *            counted from the top left corner of the page
+     *   tileSize: Number - width and height of a tile in pixels (default 256)
+     * \param onTile Function. Called with each tile as soon as it is encoded
+     * \param callback Function. Called once all tiles were handed to `onTile`
+     */
+NAN_METHOD(NodePopplerPage::renderTiles)
+{
+    Nan::HandleScope scope;
+    NodePopplerPage *self = Nan::ObjectWrap::Unwrap<NodePopplerPage>(info.Holder());
+
+    if (info.Length() < 5 || !info[0]->IsString() || !info[2]->IsObject() ||
+        !info[3]->IsFunction() || !info[4]->IsFunction())
+    {
+        return Nan::ThrowError("Arguments: (method: String, PPI: Number, options: Object, onTile: Function, callback: Function)");
+    }
+
+    TileWork *work = new TileWork(self);
+    work->callback = new Nan::Callback(info[4].As<v8::Function>());
+    work->onTile = new Nan::Callback(info[3].As<v8::Function>());
+    RenderWork *settings = &work->settings;
+
+    if (self->isDocClosed())
+    {
+        Local<Value> err = Nan::Error("Document closed. You must delete this page");
+        THROW_SYNC_ASYNC_ERR(work, err);
+    }
+
+    settings->setWriter(info[0]);
+    if (!settings->error && settings->w == W_RAW)
+    {
+        settings->error = new char[strlen("Unsupported compression method") + 1];
+        strcpy(settings->error, "Unsupported compression method");
+    }
+    if (!settings->error)
+        settings->setPPI(info[1]);
+    if (!settings->error && Nan::Has(To<v8::Object>(info[2]).ToLocalChecked(), Nan::New("slice").ToLocalChecked()).FromMaybe(false))
+    {
+        const char *e = "'slice' option can't be used with tiles";
+        settings->error = new char[strlen(e) + 1];
+        strcpy(settings->error, e);
+    }
+    if (!settings->error)
+        settings->setWriterOptions(info[2]);
+    if (!settings->error)
+        work->setTiles(info[2]);
+    if (settings->error)
+    {
+        Local<Value> err = Nan::Error(settings->error);
+        THROW_SYNC_ASYNC_ERR(work, err);
+    }
+
+    work->queue = new ProgressQueue();
+    // keep the page and its document alive until the last tile is delivered
+    work->pageHandle.Reset(info.Holder());
+    settings->docHandle.Reset(self->parent->handle());
+    RenderPool::queue(&work->request, AsyncTilesWork, AsyncTilesAfter, settings->priority);
+}
+
+/**
+     * Renders page to a Buffer, preceded by a quick low resolution preview
+     *
+     * Javascript function
+     *
+     * \param method String \see NodePopplerPage::renderToFile
+     * \param PPI Number \see NodePopplerPage::renderToFile
+     * \param options Object \see NodePopplerPage::renderToFile, plus:
+     *   previewPPI: Number - resolution of the preview (default 36)
+     * \param onPreview Function. Called with the preview
+     * \param callback Function. Called with the image at `PPI`
+     */
+NAN_METHOD(NodePopplerPage::renderProgressive)
+{
+    Nan::HandleScope scope;
+    NodePopplerPage *self = Nan::ObjectWrap::Unwrap<NodePopplerPage>(info.Holder());
+
+    if (info.Length() < 5 || !info[0]->IsString() || !info[2]->IsObject() ||
+        !info[3]->IsFunction() || !info[4]->IsFunction())
+    {
+        return Nan::ThrowError("Arguments: (method: String, PPI: Number, options: Object, onPreview: Function, callback: Function)");
+    }
+
+    RenderWork *work = new RenderWork(self, DEST_BUFFER);
+    work->callback = new Nan::Callback(info[4].As<v8::Function>());
+    work->onPreview = new Nan::Callback(info[3].As<v8::Function>());
+
+    if (self->isDocClosed())
+    {
+        Local<Value> err = Nan::Error("Document closed. You must delete this page");
+        THROW_SYNC_ASYNC_ERR(work, err);
+    }
+
+    work->setWriter(info[0]);
+    if (!work->error && work->w == W_RAW)
+    {
+        work->error = new char[strlen("Unsupported compression method") + 1];
+        strcpy(work->error, "Unsupported compression method");
+    }
+    if (!work->error)
+        work->setPPI(info[1]);
+    if (!work->error)
+        work->setWriterOptions(info[2]);
+    Local<String> ppk = Nan::New("previewPPI").ToLocalChecked();
+    Local<v8::Object> options = To<v8::Object>(info[2]).ToLocalChecked();
+    if (!work->error && Nan::Has(options, ppk).FromMaybe(false))
+    {
+        Local<Value> ppv = Nan::Get(options, ppk).ToLocalChecked();
+        if (ppv->IsNumber() && To<double>(ppv).FromJust() > 0)
+        {
+            work->previewPPI = To<double>(ppv).FromJust();
+        }
+        else
+        {
+            const char *e = "'previewPPI' option value must be a positive number";
+            work->error = new char[strlen(e) + 1];
+            strcpy(work->error, e);
+        }
+    }
+    if (!work->error)
+        work->openStream();
+    if (work->error)
+    {
+        Local<Value> err = Nan::Error(work->error);
+        THROW_SYNC_ASYNC_ERR(work, err);
+    }
+
+    work->progress = new ProgressQueue();
+    self->renderToStream(work);
+}
+
+/**
+     * Renders page in horizontal bands, encoding each band before the next
+     * one is rendered. Memory use depends on the band height, not the page size.
+     *
+     * Javascript function
+     *
+     * \param method String \see NodePopplerPage::renderToFile
+     * \param PPI Number \see NodePopplerPage::renderToFile
+     * \param options Object \see NodePopplerPage::renderToFile, plus:
+     *   bandHeight: Number - rows rendered at once (default 256)
+     *   stallTimeoutMs: Number - how long to wait for a chunk to be
+     *                   acknowledged, 0 for no limit (default 60000)
+     * \param onChunk Function. Called with (chunk: Buffer, ack: Function) for
+     *                each chunk of encoded output. `ack(count = 1)` tells that
+     *                chunks were consumed.
+     * \param callback Function. Called after the last chunk
+     */
+NAN_METHOD(NodePopplerPage::renderBands)
+{
+    Nan::HandleScope scope;
+    NodePopplerPage *self = Nan::ObjectWrap::Unwrap<NodePopplerPage>(info.Holder());
+
+    if (info.Length() < 5 || !info[0]->IsString() || !info[2]->IsObject() || !info[3]->IsFunction() || !info[4]->IsFunction())
+    {
+        return Nan::ThrowError("Arguments: (method: String, PPI: Number, options: Object, onChunk: Function, callback: Function)");
+    }
+
+    RenderWork *work = new RenderWork(self, DEST_BUFFER);
+    work->callback = new Nan::Callback(info[4].As<v8::Function>());
+    work->onChunk = new Nan::Callback(info[3].As<v8::Function>());
+    work->chunkWindow.reset(new ChunkStream::Window());
+    work->chunkAck.Reset(ChunkStream::ackFunction(work->chunkWindow));
+    work->bandHeight = 256;
+
+    if (self->isDocClosed())
+    {
+        Local<Value> err = Nan::Error("Document closed. You must delete this page");
+        THROW_SYNC_ASYNC_ERR(work, err);
+    }
+
+    work->setWriter(info[0]);
+    if (!work->error && work->w == W_RAW)
+    {
+        work->error = new char[strlen("Unsupported compression method") + 1];
+        strcpy(work->error, "Unsupported compression method");
+    }
+    if (!work->error)
+        work->setPPI(info[1]);
+    Local<String> bhk = Nan::New("bandHeight").ToLocalChecked();
+    Local<v8::Object> options = To<v8::Object>(info[2]).ToLocalChecked();
+    if (!work->error && Nan::Has(options, bhk).FromMaybe(false))
+    {
+        Local<Value> bhv = Nan::Get(options, bhk).ToLocalChecked();
+        if (bhv->IsUint32() && To<uint32_t>(bhv).FromJust() > 0)
+        {
+            work->bandHeight = To<uint32_t>(bhv).FromJust();
+        }
+        else
+        {
+            const char *e = "'bandHeight' option value must be a positive integer";
+            work->error = new char[strlen(e) + 1];
+            strcpy(work->error, e);
+        }
+    }
+    Local<String> stk = Nan::New("stallTimeoutMs").ToLocalChecked();
+    if (!work->error && Nan::Has(options, stk).FromMaybe(false))
+    {
+        Local<Value> stv = Nan::Get(options, stk).ToLocalChecked();
+        if (stv->IsUint32())
+        {
+            work->stallTimeoutMs = To<uint32_t>(stv).FromJust();
+        }
+        else
+        {
+            const char *e = "'stallTimeoutMs' option value must be a non-negative integer";
+            work->error = new char[strlen(e) + 1];
+            strcpy(work->error, e);
+        }
+    }
+    if (!work->error)
+        work->setWriterOptions(info[2]);
+    if (work->error)
+    {
+        Local<Value> err = Nan::Error(work->error);
+        THROW_SYNC_ASYNC_ERR(work, err);
+    }
+
+    work->progress = new ProgressQueue();
+    work->docHandle.Reset(self->parent->handle());
+    RenderPool::queue(&work->request, AsyncBandsWork, AsyncRenderAfter, work->priority);
+}
+
+void NodePopplerPage::AsyncBandsWork(uv_work_t *req)
+{
+    RenderWork *work = static_cast<RenderWork *>(req->data);
+    displayBands(work);
+}
+
+/**
+     * Renders the slice band by band, feeding rows to the encoder, whose
+     * output goes to JS through a ChunkStream
+     */
+void NodePopplerPage::displayBands(RenderWork *work)
+{
+    int sx, sy, sw, sh;
+    std::tie(sx, sy, sw, sh) = work->applyScale();
+    if (work->error)
+        return;
+    if (work->shouldAbort())
+    {
+        work->setAbortError();
+        return;
+    }
+
+    ChunkStream chunks(
+        work->progress,
+        [work](char *data, size_t len) {
+            Local<Value> argv[] = {Nan::NewBuffer(data, len).ToLocalChecked(), Nan::New(work->chunkAck)};
+            Nan::TryCatch try_catch;
+            Nan::AsyncResource res(Nan::New("poppler-simple::render-chunk").ToLocalChecked());
+            work->onChunk->Call(2, argv, &res);
+            if (try_catch.HasCaught())
+            {
+                Nan::FatalException(try_catch);
+            }
+        },
+        work->chunkWindow,
+        [work]() { return work->shouldAbort(); },
+        work->stallTimeoutMs);
+    FILE *chunkFile = chunks.open();
+    if (chunkFile == NULL)
+    {
+        const char *e = "Could not open output stream";
+        work->error = new char[strlen(e) + 1];
+        strcpy(work->error, e);
+        return;
+    }
+    // libtiff patches the header last, so TIFF goes through a temporary file,
+    // or through memory where no temporary file can be created
+    MemoryStream tiffStream;
+    FILE *out = chunkFile;
+    int tmpErrno = 0;
+    if (work->w == W_TIFF)
+    {
+        out = tmpfile();
+        tmpErrno = errno;
+        if (out == NULL && !tiffNeedsFileHelper())
+            out = tiffStream.open();
+    }
+    if (out == NULL)
+    {
+        fclose(chunkFile);
+        char err[256];
+        snprintf(err, sizeof(err), "Could not create a temporary file for tiff output: %s", strerror(tmpErrno));
+        work->error = new char[strlen(err) + 1];
+        strcpy(work->error, err);
+        return;
+    }
+
+    RenderContextPool *contexts = work->self->parent->renderContexts.get();
+    RangeLoader::AbortScope abortScope([work]() { return work->shouldAbort(); });
+    RenderContextPool::Context *ctx = NULL;
+    Page *page = NULL;
+    ImgWriter *writer = work->makeWriter();
+    bool ok = writer->init(out, sw, sh, (int)work->PPI, (int)work->PPI);
+    std::vector<unsigned char> scratch;
+    std::vector<unsigned char> band;
+    for (int y = 0; ok && y < sh; y += work->bandHeight)
+    {
+        if (ctx == NULL)
+        {
+            ctx = contexts->acquire(work->splashMode(), work->paper);
+            page = ctx->doc->getPage(work->self->getNum());
+            if (page == NULL)
+            {
+                work->error = new char[strlen(PAGE_READ_ERROR) + 1];
+                strcpy(work->error, PAGE_READ_ERROR);
+                ok = false;
+                break;
+            }
+        }
+        int bh = std::min(work->bandHeight, sh - y);
+        page->displaySlice(ctx->out, work->PPI, work->PPI,
+                           0, false, true,
+                           sx, sy + y, sw, bh,
+                           false, abortCheck, work);
+        if (work->errorCode)
+        {
+            ok = false;
+            break;
+        }
+        SplashBitmap *bitmap = ctx->out->getBitmap();
+        int rows = std::min(bh, bitmap->getHeight());
+        if (ctx->shared)
+        {
+            // the shared document is locked until release, so the band is
+            // copied out and the context given back before the encoder may
+            // wait for JS to take its output
+            size_t rowSize = work->encoderRowSize(sw);
+            band.resize(rowSize * bh);
+            for (int row = 0; row < bh; row++)
+            {
+                // repeat the last row should the band come out short
+                memcpy(band.data() + rowSize * row, work->encoderRow(bitmap, 0, std::min(row, rows - 1), sw, scratch), rowSize);
+            }
+            contexts->release(ctx);
+            ctx = NULL;
+            for (int row = 0; ok && row < bh; row++)
+            {
+                unsigned char *p = band.data() + rowSize * row;
+                ok = writer->writeRow(&p);
+            }
+            continue;
+        }
+        for (int row = 0; ok && row < bh; row++)
+        {
+            // repeat the last row should the band come out short
+            unsigned char *p = work->encoderRow(bitmap, 0, std::min(row, rows - 1), sw, scratch);
+            ok = writer->writeRow(&p);
+        }
+    }
+    ok = ok && writer->close();
+    delete writer;
+    if (ctx != NULL)
+        contexts->release(ctx);
+
+    if (out != chunkFile)
+    {
+        ok = ok && fflush(out) == 0 && fseek(out, 0, SEEK_SET) == 0 && chunks.copyFrom(out);
+        fclose(out);
+    }
+    ok = fclose(chunkFile) == 0 && ok;
+
+    if (chunks.hasStalled() && !work->errorCode)
+    {
+        work->errorCode = "ERR_RENDER_STALLED";
+    }
+    if (work->errorCode)
+    {
+        work->setAbortError();
+    }
+    else if (!ok && !work->error)
+    {
+        const char *e = "Could not encode image";
+        work->error = new char[strlen(e) + 1];
+        strcpy(work->error, e);
+    }
+}
+
+void NodePopplerPage::TileWork::setTiles(const Local<Value> optsVal)
+{
+    Nan::HandleScope scope;
+    Local<v8::Object> options = To<v8::Object>(optsVal).ToLocalChecked();
+    Local<String> tsk = Nan::New("tileSize").ToLocalChecked();
+    Local<String> tk = Nan::New("tiles").ToLocalChecked();
+    const char *e = NULL;
+
+    if (Nan::Has(options, tsk).FromMaybe(false))
+    {
+        Local<Value> tsv = Nan::Get(options, tsk).ToLocalChecked();
+        if (tsv->IsUint32() && To<uint32_t>(tsv).FromJust() > 0 && To<uint32_t>(tsv).FromJust() <= 4096)
+        {
+            this->tileSize = To<uint32_t>(tsv).FromJust();
+        }
+        else
+        {
+            e = "'tileSize' option value must be an integer from 1 to 4096";
+        }
+    }
+
+    // page size in pixels, as computed by RenderWork::applyScale
+    double scale = settings.PPI / 72.0;
+    int width = settings.self->getWidth() * scale;
+    int height = settings.self->getHeight() * scale;
+    Local<Value> tv = Nan::Get(options, tk).ToLocalChecked();
+    if (!e && (!tv->IsArray() || tv.As<v8::Array>()->Length() == 0))
+    {
+        e = "'tiles' option value must be a non-empty Array";
+    }
+    for (uint32_t i = 0; !e && i < tv.As<v8::Array>()->Length(); i++)
+    {
+        Local<Value> tile = Nan::Get(tv.As<v8::Array>(), i).ToLocalChecked();
+        Local<Value> xv, yv;
+        if (!tile->IsObject() ||
+            !(xv = Nan::Get(tile.As<v8::Object>(), Nan::New("x").ToLocalChecked()).ToLocalChecked())->IsUint32() ||
+            !(yv = Nan::Get(tile.As<v8::Object>(), Nan::New("y").ToLocalChecked()).ToLocalChecked())->IsUint32())
+        {
+            e = "Tile must be an object: {x: Number, y: Number} with non-negative integers";
+            break;
+        }
+        Tile t = {(int)To<uint32_t>(xv).FromJust(), (int)To<uint32_t>(yv).FromJust()};
+        if ((double)t.x * tileSize >= width || (double)t.y * tileSize >= height)
+        {
+            e = "Tile is outside of the page";
+            break;
+        }
+        this->tiles.push_back(t);
+    }
+    if (e)
+    {
+        settings.error = new char[strlen(e) + 1];
+        strcpy(settings.error, e);
+    }
+}
+
+/**
+     * Renders the area covered by the tiles and posts every tile to the main thread
+     */
+void NodePopplerPage::displayTiles(TileWork *work)
+{
+    RenderWork *settings = &work->settings;
+    int ts = work->tileSize;
+    double scale = settings->PPI / 72.0;
+    int width = (int)(settings->self->getWidth() * scale);
+    int height = (int)(settings->self->getHeight() * scale);
+    int x0 = INT_MAX, y0 = INT_MAX, x1 = 0, y1 = 0;
+    unsigned long area = 0;
+    for (const TileWork::Tile &t : work->tiles)
+    {
+        x0 = std::min(x0, t.x * ts);
+        y0 = std::min(y0, t.y * ts);
+        x1 = std::max(x1, std::min((t.x + 1) * ts, width));
+        y1 = std::max(y1, std::min((t.y + 1) * ts, height));
+        area += (unsigned long)(std::min((t.x + 1) * ts, width) - t.x * ts) * (std::min((t.y + 1) * ts, height) - t.y * ts);
+    }
+    // one slice for tiles close together, distant tiles are rendered one by
+    // one rather than with everything in between
+    unsigned long boxArea = (unsigned long)(x1 - x0) * (y1 - y0);
+    bool together = boxArea <= 4 * area && boxArea <= 100000000UL;
+    if (settings->shouldAbort())
+    {
+        settings->setAbortError();
+        return;
+    }
+
+    RenderContextPool *contexts = settings->self->parent->renderContexts.get();
+    RangeLoader::AbortScope abortScope([settings]() { return settings->shouldAbort(); });
+    RenderContextPool::Context *ctx = contexts->acquire(settings->splashMode(), settings->paper);
+    Page *page = ctx->doc->getPage(settings->self->getNum());
+    if (page == NULL)
     {
+        contexts->release(ctx);
+        settings->error = new char[strlen(PAGE_READ_ERROR) + 1];
+        strcpy(settings->error, PAGE_READ_ERROR);
         return;
     }
-    else
+
+    int sx = x0, sy = y0;
+    for (size_t i = 0; i < work->tiles.size(); i++)
     {
-        work->closeStream();
-        if (work->error)
+        const TileWork::Tile &t = work->tiles[i];
+        if (!together || i == 0)
         {
-            Local<Value> e = Nan::Error(work->error);
-            unlink(work->filename);
-            delete work;
-            return Nan::ThrowError(e);
+            if (!together)
+            {
+                sx = t.x * ts;
+                sy = t.y * ts;
+                x1 = std::min(sx + ts, width);
+                y1 = std::min(sy + ts, height);
+            }
+            page->displaySlice(ctx->out, settings->PPI, settings->PPI,
+                               0, false, true,
+                               sx, sy, x1 - sx, y1 - sy,
+                               false, abortCheck, settings);
         }
-        else
+        if (settings->errorCode || settings->shouldAbort())
         {
-            Local<v8::Object> out = Nan::New<v8::Object>();
-            Nan::Set(out, Nan::New("type").ToLocalChecked(), Nan::New("file").ToLocalChecked());
-            Nan::Set(out, Nan::New("path").ToLocalChecked(), Nan::New(work->filename).ToLocalChecked());
-            delete work;
-            info.GetReturnValue().Set(out);
+            settings->setAbortError();
+            break;
+        }
+        SplashBitmap *bitmap = ctx->out->getBitmap();
+        int x = t.x * ts - sx;
+        int y = t.y * ts - sy;
+        int w = std::min(ts, bitmap->getWidth() - x);
+        int h = std::min(ts, bitmap->getHeight() - y);
+        size_t len;
+        char *data = settings->encodeRegion(bitmap, x, y, w, h, &len);
+        if (data == NULL)
+        {
+            break;
         }
+        work->queue->post([work, t, w, h, data, len]() {
+            Local<v8::Object> out = Nan::New<v8::Object>();
+            Nan::Set(out, Nan::New("type").ToLocalChecked(), Nan::New("buffer").ToLocalChecked());
+            Nan::Set(out, Nan::New("format").ToLocalChecked(), Nan::New(work->settings.format).ToLocalChecked());
+            Nan::Set(out, Nan::New("data").ToLocalChecked(), Nan::NewBuffer(data, len).ToLocalChecked());
+            Nan::Set(out, Nan::New("x").ToLocalChecked(), Nan::New<Uint32>(t.x));
+            Nan::Set(out, Nan::New("y").ToLocalChecked(), Nan::New<Uint32>(t.y));
+            Nan::Set(out, Nan::New("width").ToLocalChecked(), Nan::New<Uint32>(w));
+            Nan::Set(out, Nan::New("height").ToLocalChecked(), Nan::New<Uint32>(h));
+            Local<Value> argv[] = {out};
+            Nan::TryCatch try_catch;
+            Nan::AsyncResource res(Nan::New("poppler-simple::render-tile").ToLocalChecked());
+            work->onTile->Call(1, argv, &res);
+            if (try_catch.HasCaught())
+            {
+                Nan::FatalException(try_catch);
+            }
+        });
+    }
+    contexts->release(ctx);
+}
+
+void NodePopplerPage::AsyncTilesWork(uv_work_t *req)
+{
+    TileWork *work = static_cast<TileWork *>(req->data);
+    displayTiles(work);
+}
+
+void NodePopplerPage::AsyncTilesAfter(uv_work_t *req, int status)
+{
+    Nan::HandleScope scope;
+    TileWork *work = static_cast<TileWork *>(req->data);
+
+    // tiles still in the queue go out before the final callback
+    work->queue->close();
+    Local<Value> argv[] = {Nan::Null()};
+    if (work->settings.error)
+    {
+        argv[0] = renderError(work->settings.error, work->settings.errorCode);
+    }
+    Nan::TryCatch try_catch;
+    Nan::AsyncResource res(Nan::New("poppler-simple::render-tiles").ToLocalChecked());
+    work->callback->Call(1, argv, &res);
+    if (try_catch.HasCaught())
+    {
+        Nan::FatalException(try_catch);
     }
+    delete work;
 }
 
 void NodePopplerPage::RenderWork::setWriter(const Local<Value> method)
@@ -960,6 +2186,10 @@ void NodePopplerPage::RenderWork::setWriter(const Local<Value> method)
         {
             this->w = W_TIFF;
         }
+        else if (strncmp(*m, "raw", 3) == 0 && this->dest == DEST_BUFFER)
+        {
+            this->w = W_RAW;
+        }
         else
         {
             e = (char *)"Unsupported compression method";
@@ -976,7 +2206,8 @@ void NodePopplerPage::RenderWork::setWriter(const Local<Value> method)
     }
     else
     {
-        strcpy(this->format, *m);
+        const char *formats[] = {"png", "jpeg", "tiff", "raw"};
+        strcpy(this->format, formats[this->w]);
     }
 }
 
@@ -988,6 +2219,12 @@ void NodePopplerPage::RenderWork::setWriterOptions(const Local<Value> optsVal)
     Local<String> qk = Nan::New("quality").ToLocalChecked();
     Local<String> pk = Nan::New("progressive").ToLocalChecked();
     Local<String> sk = Nan::New("slice").ToLocalChecked();
+    Local<String> cmk = Nan::New("colorMode").ToLocalChecked();
+    Local<String> dk = Nan::New("deadlineMs").ToLocalChecked();
+    Local<String> ak = Nan::New("abortFlag").ToLocalChecked();
+    Local<String> prk = Nan::New("priority").ToLocalChecked();
+    Local<String> cak = Nan::New("cache").ToLocalChecked();
+    Local<String> bgk = Nan::New("background").ToLocalChecked();
     Local<v8::Object> options;
     char *e = NULL;
 
@@ -1061,8 +2298,142 @@ void NodePopplerPage::RenderWork::setWriterOptions(const Local<Value> optsVal)
         }
         break;
         case W_PNG:
+        case W_RAW:
             break;
         }
+        if (!e && Nan::Has(options, cmk).FromMaybe(false))
+        {
+            // rgba is for raw pixels only, mono needs a bilevel capable encoder
+            Local<Value> cmv = Nan::Get(options, cmk).ToLocalChecked();
+            Nan::Utf8String cm(cmv);
+            bool isRaw = this->w == W_RAW;
+            if (cmv->IsString() && strcmp(*cm, "rgb") == 0)
+            {
+                this->colorMode = CM_RGB;
+            }
+            else if (cmv->IsString() && strcmp(*cm, "rgba") == 0 && isRaw)
+            {
+                this->colorMode = CM_RGBA;
+            }
+            else if (cmv->IsString() && strcmp(*cm, "gray") == 0)
+            {
+                this->colorMode = CM_GRAY;
+            }
+            else if (cmv->IsString() && strcmp(*cm, "mono") == 0 && (this->w == W_PNG || this->w == W_TIFF))
+            {
+                this->colorMode = CM_MONO;
+            }
+            else if (isRaw)
+            {
+                e = (char *)"'colorMode' option value must be 'rgb', 'rgba' or 'gray'";
+            }
+            else if (this->w == W_JPEG)
+            {
+                e = (char *)"'colorMode' option value must be 'rgb' or 'gray'";
+            }
+            else
+            {
+                e = (char *)"'colorMode' option value must be 'rgb', 'gray' or 'mono'";
+            }
+        }
+        if (!e && Nan::Has(options, bgk).FromMaybe(false))
+        {
+            Local<Value> bgv = Nan::Get(options, bgk).ToLocalChecked();
+            if (bgv->IsString() && strcmp(*Nan::Utf8String(bgv), "transparent") == 0)
+            {
+                // alpha survives only in RGBA png and raw rgba pixels
+                if ((this->w == W_PNG && this->colorMode == CM_RGB) || (this->w == W_RAW && this->colorMode == CM_RGBA))
+                {
+                    this->transparent = true;
+                }
+                else
+                {
+                    e = (char *)"'background' can be 'transparent' only for png in 'rgb' or raw in 'rgba' color mode";
+                }
+            }
+            else if (bgv->IsArray() && bgv.As<v8::Array>()->Length() == 3)
+            {
+                Local<v8::Array> rgb = bgv.As<v8::Array>();
+                for (uint32_t i = 0; !e && i < 3; i++)
+                {
+                    Local<Value> c = Nan::Get(rgb, i).ToLocalChecked();
+                    if (c->IsUint32() && To<uint32_t>(c).FromJust() <= 255)
+                    {
+                        this->paper[i] = (unsigned char)To<uint32_t>(c).FromJust();
+                    }
+                    else
+                    {
+                        e = (char *)"'background' color components must be integers from 0 to 255";
+                    }
+                }
+            }
+            else
+            {
+                e = (char *)"'background' option value must be 'transparent' or an [r, g, b] array";
+            }
+        }
+        if (!e && Nan::Has(options, dk).FromMaybe(false))
+        {
+            Local<Value> dv = Nan::Get(options, dk).ToLocalChecked();
+            double ms = dv->IsNumber() ? To<double>(dv).FromJust() : -1;
+            if (ms >= 0)
+            {
+                // counts from the call, so time spent waiting for a worker is included
+                this->hasDeadline = true;
+                this->deadline = std::chrono::steady_clock::now() +
+                                 std::chrono::microseconds((int64_t)(ms * 1000));
+            }
+            else
+            {
+                e = (char *)"'deadlineMs' option value must be a non-negative number";
+            }
+        }
+        if (!e && Nan::Has(options, ak).FromMaybe(false))
+        {
+            Local<Value> av = Nan::Get(options, ak).ToLocalChecked();
+            if (av->IsInt32Array() && Nan::TypedArrayContents<int32_t>(av).length() > 0)
+            {
+                this->abortFlagHandle.Reset(av);
+                this->abortFlag = *Nan::TypedArrayContents<int32_t>(av);
+            }
+            else
+            {
+                e = (char *)"'abortFlag' option must be a non-empty Int32Array";
+            }
+        }
+        if (!e && Nan::Has(options, prk).FromMaybe(false))
+        {
+            Local<Value> prv = Nan::Get(options, prk).ToLocalChecked();
+            Nan::Utf8String pr(prv);
+            if (prv->IsString() && strcmp(*pr, "high") == 0)
+            {
+                this->priority = RenderPool::P_HIGH;
+            }
+            else if (prv->IsString() && strcmp(*pr, "normal") == 0)
+            {
+                this->priority = RenderPool::P_NORMAL;
+            }
+            else if (prv->IsString() && strcmp(*pr, "low") == 0)
+            {
+                this->priority = RenderPool::P_LOW;
+            }
+            else
+            {
+                e = (char *)"'priority' option value must be 'high', 'normal' or 'low'";
+            }
+        }
+        if (!e && Nan::Has(options, cak).FromMaybe(false))
+        {
+            Local<Value> cav = Nan::Get(options, cak).ToLocalChecked();
+            if (cav->IsBoolean())
+            {
+                this->cache = To<bool>(cav).FromJust();
+            }
+            else
+            {
+                e = (char *)"'cache' option value must be a boolean value";
+            }
+        }
         if (Nan::Has(options, sk).FromMaybe(false))
         {
             this->setSlice(Nan::Get(options, sk).ToLocalChecked());
@@ -1144,19 +2515,21 @@ void NodePopplerPage::RenderWork::setPath(const Local<Value> path)
     }
 }
 
-std::tuple<int, int, int, int> NodePopplerPage::RenderWork::applyScale()
+std::tuple<int, int, int, int> NodePopplerPage::RenderWork::applyScale(double ppi)
 {
     char *e = NULL;
     double scale, scaledWidth, scaledHeight;
     int scaled_x, scaled_y, scaled_w, scaled_h;
-    scale = PPI / 72.0;
+    scale = ppi / 72.0;
     scaledWidth = self->getWidth() * scale;
     scaledHeight = self->getHeight() * scale;
     scaled_w = scaledWidth * slice_w;
     scaled_h = scaledHeight * slice_h;
     scaled_x = scaledWidth * slice_x;
     scaled_y = scaledHeight - scaledHeight * slice_y - scaledHeight * slice_h;
-    if ((unsigned long)(scaled_w * scaled_h) > 100000000L)
+    // only one band of a band render is held in memory
+    int held_h = bandHeight > 0 ? std::min(bandHeight, scaled_h) : scaled_h;
+    if ((unsigned long)scaled_w * held_h > 100000000L)
     {
         e = (char *)"Result image is too big";
     }
@@ -1236,6 +2609,327 @@ void NodePopplerPage::RenderWork::setSlice(const Local<Value> sliceVal)
     }
 }
 
+/**
+     * Moves rendered pixels into the output buffer without encoding them
+     */
+void NodePopplerPage::RenderWork::takePixels(SplashBitmap *bitmap)
+{
+    this->raw_width = bitmap->getWidth();
+    this->raw_height = bitmap->getHeight();
+    if (this->colorMode == CM_RGBA)
+    {
+        // XBGR8 rows are stored as B, G, R, X
+        this->raw_stride = this->raw_width * 4;
+        this->mstrm_len = (size_t)this->raw_stride * this->raw_height;
+        this->mstrm_buf = (char *)malloc(this->mstrm_len);
+        if (this->mstrm_buf == NULL)
+        {
+            char *e = (char *)"Could not allocate output buffer";
+            this->error = new char[strlen(e) + 1];
+            strcpy(this->error, e);
+            return;
+        }
+        std::vector<unsigned char> scratch;
+        for (int y = 0; y < this->raw_height; y++)
+        {
+            unsigned char *dst = (unsigned char *)this->mstrm_buf + (size_t)y * this->raw_stride;
+            if (this->transparent)
+            {
+                memcpy(dst, encoderRow(bitmap, 0, y, this->raw_width, scratch), this->raw_stride);
+                continue;
+            }
+            unsigned char *src = bitmap->getDataPtr() + (size_t)y * bitmap->getRowSize();
+            for (int x = 0; x < this->raw_width; x++)
+            {
+                dst[4 * x] = src[4 * x + 2];
+                dst[4 * x + 1] = src[4 * x + 1];
+                dst[4 * x + 2] = src[4 * x];
+                dst[4 * x + 3] = 255;
+            }
+        }
+    }
+    else
+    {
+        // RGB8 and Mono8 rows already have the requested layout,
+        // so the bitmap data is taken over as is
+        this->raw_stride = bitmap->getRowSize();
+        this->mstrm_len = (size_t)this->raw_stride * this->raw_height;
+        this->mstrm_buf = (char *)bitmap->takeData();
+    }
+}
+
+/**
+     * Bitmap mode the page is rendered in for the configured color mode
+     */
+SplashColorMode NodePopplerPage::RenderWork::splashMode()
+{
+    if (this->transparent)
+    {
+        return splashModeXBGR8;
+    }
+    switch (this->colorMode)
+    {
+    case CM_RGBA:
+        return splashModeXBGR8;
+    case CM_GRAY:
+        return splashModeMono8;
+    case CM_MONO:
+        return splashModeMono1;
+    default:
+        return splashModeRGB8;
+    }
+}
+
+/**
+     * Creates the encoder for the configured format, NULL for raw output
+     */
+ImgWriter *NodePopplerPage::RenderWork::makeWriter()
+{
+    ImgWriter *writer = NULL;
+    switch (this->w)
+    {
+    case W_PNG:
+        writer = new PNGWriter(this->transparent ? PNGWriter::RGBA
+                               : this->colorMode == CM_MONO ? PNGWriter::MONOCHROME
+                               : this->colorMode == CM_GRAY ? PNGWriter::GRAY
+                                                            : PNGWriter::RGB);
+        break;
+    case W_JPEG:
+        writer = new JpegWriter(this->quality, this->progressive,
+                                this->colorMode == CM_GRAY ? JpegWriter::GRAY : JpegWriter::RGB);
+        break;
+    case W_TIFF:
+        writer = new TiffWriter(this->colorMode == CM_MONO ? TiffWriter::MONOCHROME
+                                : this->colorMode == CM_GRAY ? TiffWriter::GRAY
+                                                             : TiffWriter::RGB);
+        if (this->compression != NULL)
+        {
+            ((TiffWriter *)writer)->setCompressionString(this->compression);
+        }
+        else if (this->colorMode == CM_MONO)
+        {
+            // CCITT Group 4, the usual choice for bilevel scans
+            ((TiffWriter *)writer)->setCompressionString("ccittfax4");
+        }
+        break;
+    case W_RAW:
+        break;
+    }
+    return writer;
+}
+
+/**
+     * Encodes a rectangle of a bitmap rendered in splashMode() into a malloc'ed buffer
+     *
+     * \return encoded image, its length in `len`, or NULL with `error` set
+     */
+char *NodePopplerPage::RenderWork::encodeRegion(SplashBitmap *bitmap, int x, int y, int width, int height, size_t *len)
+{
+    MemoryStream *mstrm = NULL;
+    FILE *out;
+    if (this->w == W_TIFF && tiffNeedsFileHelper())
+    {
+        out = tmpfile();
+    }
+    else
+    {
+        mstrm = new MemoryStream((size_t)width * height * 3 + 65536);
+        out = mstrm->open();
+    }
+    if (out == NULL)
+    {
+        delete mstrm;
+        const char *e = "Could not open output stream";
+        this->error = new char[strlen(e) + 1];
+        strcpy(this->error, e);
+        return NULL;
+    }
+
+    ImgWriter *writer = makeWriter();
+    bool ok = writeRegion(writer, out, bitmap, x, y, width, height);
+    delete writer;
+
+    char *buf = NULL;
+    if (mstrm != NULL)
+    {
+        fclose(out);
+        *len = mstrm->getBufferLen();
+        buf = mstrm->giveBuffer();
+        delete mstrm;
+    }
+    else
+    {
+        long size;
+        if (fflush(out) == 0 && fseek(out, 0, SEEK_END) == 0 && (size = ftell(out)) > 0)
+        {
+            *len = size;
+            buf = (char *)malloc(*len);
+            rewind(out);
+            if (buf != NULL && fread(buf, 1, *len, out) != *len)
+            {
+                free(buf);
+                buf = NULL;
+            }
+        }
+        fclose(out);
+    }
+    if (!ok || buf == NULL)
+    {
+        free(buf);
+        const char *e = "Could not encode image";
+        this->error = new char[strlen(e) + 1];
+        strcpy(this->error, e);
+        return NULL;
+    }
+    return buf;
+}
+
+/**
+     * Encodes a rectangle of a bitmap rendered in splashMode() to `out`
+     */
+bool NodePopplerPage::RenderWork::writeRegion(ImgWriter *writer, FILE *out, SplashBitmap *bitmap, int x, int y, int width, int height)
+{
+    std::vector<unsigned char> scratch;
+    bool ok = writer->init(out, width, height, (int)this->PPI, (int)this->PPI);
+    for (int row = 0; ok && row < height; row++)
+    {
+        unsigned char *p = encoderRow(bitmap, x, y + row, width, scratch);
+        ok = writer->writeRow(&p);
+    }
+    return ok && writer->close();
+}
+
+/**
+     * Row `y` of a bitmap from pixel `x` on, in the layout makeWriter()'s encoder takes.
+     * Rows that need converting are built in `scratch`.
+     */
+unsigned char *NodePopplerPage::RenderWork::encoderRow(SplashBitmap *bitmap, int x, int y, int width, std::vector<unsigned char> &scratch)
+{
+    unsigned char *p = bitmap->getDataPtr() + (size_t)y * bitmap->getRowSize();
+    if (this->colorMode == CM_MONO)
+    {
+        // rows needn't start on a byte boundary
+        scratch.resize((width + 7) / 8);
+        packMonoRow(p, x, width, scratch.data());
+        return scratch.data();
+    }
+    if (this->transparent)
+    {
+        // XBGR8 pixels are stored as B, G, R, X with alpha kept apart
+        SplashColorPtr alpha = bitmap->getAlphaPtr();
+        scratch.resize((size_t)width * 4);
+        p += (size_t)x * 4;
+        for (int i = 0; i < width; i++)
+        {
+            scratch[4 * i] = p[4 * i + 2];
+            scratch[4 * i + 1] = p[4 * i + 1];
+            scratch[4 * i + 2] = p[4 * i];
+            scratch[4 * i + 3] = alpha ? alpha[(size_t)y * bitmap->getWidth() + x + i] : 255;
+        }
+        return scratch.data();
+    }
+    return p + (size_t)x * (this->colorMode == CM_GRAY ? 1 : 3);
+}
+
+/**
+     * Length of the rows encoderRow returns
+     */
+size_t NodePopplerPage::RenderWork::encoderRowSize(int width)
+{
+    if (this->colorMode == CM_MONO)
+        return (width + 7) / 8;
+    if (this->transparent)
+        return (size_t)width * 4;
+    return (size_t)width * (this->colorMode == CM_GRAY ? 1 : 3);
+}
+
+/**
+     * Copies writer, PPI and slice settings of an already configured work
+     */
+void NodePopplerPage::RenderWork::copySettings(const RenderWork *other)
+{
+    this->w = other->w;
+    this->colorMode = other->colorMode;
+    this->transparent = other->transparent;
+    memcpy(this->paper, other->paper, sizeof(this->paper));
+    strcpy(this->format, other->format);
+    this->quality = other->quality;
+    this->progressive = other->progressive;
+    if (other->compression)
+    {
+        this->compression = new char[strlen(other->compression) + 1];
+        strcpy(this->compression, other->compression);
+    }
+    this->slice_x = other->slice_x;
+    this->slice_y = other->slice_y;
+    this->slice_w = other->slice_w;
+    this->slice_h = other->slice_h;
+    this->PPI = other->PPI;
+    this->hasDeadline = other->hasDeadline;
+    this->deadline = other->deadline;
+    // the flag's array is kept alive by `other`
+    this->abortFlag = other->abortFlag;
+    this->priority = other->priority;
+    this->cache = other->cache;
+}
+
+/**
+     * Tells whether the image may come from or go to RenderCache. Only encoded
+     * images rendered to memory are cached, and never for a modified document
+     * or one reading memory that can change (copyBuffer: false, mmap: true).
+     * Progressive renders skip the cache, a hit would never show the preview.
+     */
+bool NodePopplerPage::RenderWork::cacheable()
+{
+    return this->cache && this->stream != NULL && this->w != W_RAW && this->onPreview == NULL &&
+           !self->parent->renderContexts->isModified() && !self->parent->renderContexts->isStreamed() &&
+           !self->parent->renderContexts->hasMutableSource() &&
+           RenderCache::enabled();
+}
+
+/**
+     * Identifies the image by document data, page and every setting affecting the output
+     */
+std::string NodePopplerPage::RenderWork::cacheKey()
+{
+    char key[512];
+    snprintf(key, sizeof(key), "%s:%d:%.17g:%.17g:%.17g:%.17g:%.17g:%s:%d:%d:%s:%d:%s%02x%02x%02x",
+             self->parent->renderContexts->contentId().c_str(), self->getNum(),
+             PPI, slice_x, slice_y, slice_w, slice_h, format, quality, progressive ? 1 : 0,
+             compression ? compression : "", (int)colorMode, transparent ? "t" : "",
+             paper[0], paper[1], paper[2]);
+    return key;
+}
+
+/**
+     * Tells whether the render was cancelled from JS or ran past its deadline
+     */
+bool NodePopplerPage::RenderWork::shouldAbort()
+{
+    if (this->abortFlag && __atomic_load_n(this->abortFlag, __ATOMIC_RELAXED) != 0)
+    {
+        this->errorCode = "ERR_RENDER_ABORTED";
+        return true;
+    }
+    if (this->hasDeadline && std::chrono::steady_clock::now() >= this->deadline)
+    {
+        this->errorCode = "ERR_RENDER_TIMEOUT";
+        return true;
+    }
+    return false;
+}
+
+void NodePopplerPage::RenderWork::setAbortError()
+{
+    const char *e = "Render aborted";
+    if (strcmp(this->errorCode, "ERR_RENDER_TIMEOUT") == 0)
+        e = "Render deadline exceeded";
+    else if (strcmp(this->errorCode, "ERR_RENDER_STALLED") == 0)
+        e = "Render output wasn't consumed in time";
+    this->error = new char[strlen(e) + 1];
+    strcpy(this->error, e);
+}
+
 /**
      * Opens output stream for rendering
      */
@@ -1258,9 +2952,20 @@ void NodePopplerPage::RenderWork::openStream()
     break;
     case DEST_BUFFER:
     {
-        if (this->w != W_TIFF)
+        if (this->w == W_RAW)
+        {
+            // pixels are taken straight from the bitmap
+            return;
+        }
+        else if (this->w != W_TIFF || !tiffNeedsFileHelper())
         {
-            this->stream = new MemoryStream();
+            // Encoded output rarely exceeds the size of the RGB pixels. Untouched
+            // pages of the reservation are never backed by physical memory.
+            // The stream is seekable, so TiffWriter can patch its directory.
+            int sx, sy, sw, sh;
+            std::tie(sx, sy, sw, sh) = this->applyScale();
+            size_t capacity = this->error ? 0 : (size_t)sw * sh * 3 + 65536;
+            this->stream = new MemoryStream(capacity);
             this->f = this->stream->open();
         }
         else
@@ -1296,10 +3001,26 @@ void NodePopplerPage::RenderWork::closeStream()
     case DEST_FILE:
         fclose(this->f);
         this->f = NULL;
+        if (this->errorCode)
+        {
+            // don't leave an empty file behind a cancelled render
+            unlink(this->filename);
+        }
         break;
     case DEST_BUFFER:
     {
-        if (this->w != W_TIFF)
+        if (this->w == W_RAW || this->onChunk != NULL)
+        {
+            // no stream was opened
+            break;
+        }
+        else if (this->mstrm_buf != NULL)
+        {
+            // image came from RenderCache, the stream was never written
+            fclose(this->f);
+            this->f = NULL;
+        }
+        else if (this->w != W_TIFF || !tiffNeedsFileHelper())
         {
             fclose(this->f);
             this->f = NULL;
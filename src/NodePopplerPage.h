@@ -19,9 +19,17 @@
 #include <sys/stat.h>
 #include <unistd.h>
 #include <tuple>
+#include <chrono>
+#include <memory>
+#include <string>
+#include <vector>
 
+#include "ChunkStream.h"
 #include "iconv_string.h"
 #include "MemoryStream.h"
+#include "ProgressQueue.h"
+#include "RenderContextPool.h"
+#include "RenderPool.h"
 
 namespace node
 {
@@ -33,7 +41,15 @@ class NodePopplerPage : public Nan::ObjectWrap
     {
         W_PNG,
         W_JPEG,
-        W_TIFF /*, W_PIXBUF*/
+        W_TIFF,
+        W_RAW /*, W_PIXBUF*/
+    };
+    enum ColorMode
+    {
+        CM_RGB,
+        CM_RGBA,
+        CM_GRAY,
+        CM_MONO
     };
     enum Destination
     {
@@ -45,8 +61,9 @@ class NodePopplerPage : public Nan::ObjectWrap
     {
       public:
         RenderWork(NodePopplerPage *self, NodePopplerPage::Destination dest)
-            : callback(NULL), progressive(false), error(NULL), mstrm_buf(NULL), filename(NULL), compression(NULL), quality(100), slice_x(0), slice_y(0), slice_w(1), slice_h(1), PPI(72), f(NULL), stream(NULL), mstrm_len(0), w(W_JPEG)
+            : callback(NULL), progressive(false), error(NULL), mstrm_buf(NULL), filename(NULL), compression(NULL), quality(100), slice_x(0), slice_y(0), slice_w(1), slice_h(1), PPI(72), f(NULL), stream(NULL), mstrm_len(0), raw_width(0), raw_height(0), raw_stride(0), hasDeadline(false), abortFlag(NULL), errorCode(NULL), priority(RenderPool::P_NORMAL), cache(true), progress(NULL), previewPPI(36), onPreview(NULL), bandHeight(0), onChunk(NULL), stallTimeoutMs(60000), transparent(false), w(W_JPEG), colorMode(CM_RGB)
         {
+            paper[0] = paper[1] = paper[2] = 255;
             this->self = self;
             this->dest = dest;
             request.data = this;
@@ -64,19 +81,39 @@ class NodePopplerPage : public Nan::ObjectWrap
                 delete[] compression;
             if (callback != NULL)
                 delete callback;
+            if (onPreview != NULL)
+                delete onPreview;
+            if (onChunk != NULL)
+                delete onChunk;
             if (f)
                 fclose(f);
             if (stream)
                 delete stream;
+            docHandle.Reset();
+            abortFlagHandle.Reset();
+            chunkAck.Reset();
         }
         void setWriter(const v8::Local<v8::Value> method);
         void setWriterOptions(const v8::Local<v8::Value> optsVal);
         void setPPI(const v8::Local<v8::Value> PPI);
         void setPath(const v8::Local<v8::Value> path);
         void setSlice(const v8::Local<v8::Value> sliceVal);
+        void copySettings(const RenderWork *other);
+        void takePixels(SplashBitmap *bitmap);
+        bool shouldAbort();
+        void setAbortError();
+        bool cacheable();
+        std::string cacheKey();
+        SplashColorMode splashMode();
+        ImgWriter *makeWriter();
+        char *encodeRegion(SplashBitmap *bitmap, int x, int y, int width, int height, size_t *len);
+        bool writeRegion(ImgWriter *writer, FILE *out, SplashBitmap *bitmap, int x, int y, int width, int height);
+        unsigned char *encoderRow(SplashBitmap *bitmap, int x, int y, int width, std::vector<unsigned char> &scratch);
+        size_t encoderRowSize(int width);
         void openStream();
         void closeStream();
-        std::tuple<int, int, int, int> applyScale();
+        std::tuple<int, int, int, int> applyScale() { return applyScale(PPI); }
+        std::tuple<int, int, int, int> applyScale(double ppi);
 
         uv_work_t request;
         Nan::Callback *callback;
@@ -95,9 +132,133 @@ class NodePopplerPage : public Nan::ObjectWrap
         FILE *f;
         MemoryStream *stream;
         size_t mstrm_len;
+        int raw_width;
+        int raw_height;
+        int raw_stride;
+        bool hasDeadline;
+        std::chrono::steady_clock::time_point deadline;
+        // points into abortFlagHandle, set to non-zero from JS to cancel the render
+        int32_t *abortFlag;
+        // "ERR_RENDER_ABORTED" or "ERR_RENDER_TIMEOUT" if the render was cancelled
+        const char *errorCode;
+        RenderPool::Priority priority;
+        // look up and store the encoded image in RenderCache
+        bool cache;
+        // partial results handed to JS while the render runs
+        ProgressQueue *progress;
+        // renderProgressive: preview resolution and its callback
+        double previewPPI;
+        Nan::Callback *onPreview;
+        // renderBands: rows per band, encoder output callback, and the chunks
+        // JS has acknowledged through `chunkAck`, for backpressure
+        int bandHeight;
+        Nan::Callback *onChunk;
+        std::shared_ptr<ChunkStream::Window> chunkWindow;
+        unsigned int stallTimeoutMs;
+        // background: RGB paper color, or none with alpha kept in the output
+        bool transparent;
+        unsigned char paper[3];
         NodePopplerPage::Writer w;
+        NodePopplerPage::ColorMode colorMode;
         NodePopplerPage::Destination dest;
         NodePopplerPage *self;
+        Nan::Persistent<v8::Object> docHandle;
+        Nan::Persistent<v8::Value> abortFlagHandle;
+        Nan::Persistent<v8::Function> chunkAck;
+    };
+
+    /**
+     * State of a renderTiles call. The area covered by the tiles is rendered
+     * once and each tile is cut from it, encoded and handed to JS on its own.
+     */
+    class TileWork
+    {
+      public:
+        struct Tile
+        {
+            int x;
+            int y;
+        };
+
+        TileWork(NodePopplerPage *self)
+            : callback(NULL), onTile(NULL), tileSize(256), queue(NULL), settings(self, DEST_BUFFER)
+        {
+            request.data = this;
+        }
+        ~TileWork()
+        {
+            if (callback != NULL)
+                delete callback;
+            if (onTile != NULL)
+                delete onTile;
+            pageHandle.Reset();
+        }
+        void setTiles(const v8::Local<v8::Value> optsVal);
+
+        uv_work_t request;
+        Nan::Callback *callback;
+        Nan::Callback *onTile;
+        int tileSize;
+        // column and row of each tile, counted from the top left corner
+        std::vector<Tile> tiles;
+        ProgressQueue *queue;
+        // writer options, PPI and cancellation of all tiles, and the error if any
+        RenderWork settings;
+        Nan::Persistent<v8::Object> pageHandle;
+    };
+
+    /**
+     * Word or search match in coordinates relative to the page size
+     */
+    struct TextBox
+    {
+        double x1;
+        double y1;
+        double x2;
+        double y2;
+        std::string text;
+    };
+
+    class TextWork
+    {
+      public:
+        enum Kind
+        {
+            TW_LOAD,
+            TW_WORDS,
+            TW_FIND,
+            TW_FIND_MANY
+        };
+
+        TextWork(NodePopplerPage *self, Kind kind)
+            : callback(NULL), kind(kind), rawOrder(false), columnar(false), ucs4(NULL), ucs4_len(0), self(self)
+        {
+            request.data = this;
+        }
+        ~TextWork()
+        {
+            if (callback != NULL)
+                delete callback;
+            if (ucs4 != NULL)
+                free(ucs4);
+            pageHandle.Reset();
+            docHandle.Reset();
+        }
+
+        uv_work_t request;
+        Nan::Callback *callback;
+        Kind kind;
+        bool rawOrder;
+        bool columnar;
+        char *ucs4;
+        size_t ucs4_len;
+        std::vector<TextBox> boxes;
+        // TW_FIND_MANY: case folded terms and the matches of each
+        std::vector<std::vector<Unicode>> terms;
+        std::vector<std::vector<TextBox>> groups;
+        NodePopplerPage *self;
+        Nan::Persistent<v8::Object> pageHandle;
+        Nan::Persistent<v8::Object> docHandle;
     };
 
     NodePopplerPage(NodePopplerDocument *doc, const int32_t pageNum);
@@ -115,34 +276,63 @@ class NodePopplerPage : public Nan::ObjectWrap
         this->Wrap(o);
     }
 
-    double getWidth()
+    double getWidth() { return pageWidth(pg); }
+    double getHeight() { return pageHeight(pg); }
+    static double pageWidth(Page *page)
     {
-        return ((getRotate() == 90 || getRotate() == 270)
-                    ? pg->getCropHeight()
-                    : pg->getCropWidth());
+        return ((page->getRotate() == 90 || page->getRotate() == 270)
+                    ? page->getCropHeight()
+                    : page->getCropWidth());
     }
-    double getHeight()
+    static double pageHeight(Page *page)
     {
-        return ((getRotate() == 90 || getRotate() == 270)
-                    ? pg->getCropWidth()
-                    : pg->getCropHeight());
+        return ((page->getRotate() == 90 || page->getRotate() == 270)
+                    ? page->getCropWidth()
+                    : page->getCropHeight());
     }
     double getRotate() { return pg->getRotate(); }
+    int getNum() { return pg->getNum(); }
     bool isDocClosed() { return docClosed; }
 
     static void display(RenderWork *work);
+    static v8::Local<v8::Object> bufferResult(RenderWork *work);
+    static TextPage *layoutText(Page *page, bool rawOrder);
+    static void wordBoxes(TextPage *text, double width, double height, std::vector<TextBox> &boxes);
+    static v8::Local<v8::Value> renderError(const char *message, const char *code);
 
   protected:
     static NAN_METHOD(New);
     static NAN_METHOD(findText);
     static NAN_METHOD(getWordList);
+    static NAN_METHOD(loadText);
     static NAN_METHOD(renderToFile);
     static NAN_METHOD(renderToBuffer);
+    static NAN_METHOD(renderTiles);
+    static NAN_METHOD(renderProgressive);
+    static NAN_METHOD(renderBands);
     static NAN_METHOD(addAnnot);
     static NAN_METHOD(deleteAnnots);
 
+#if POPPLER_VERSION_MAJOR == 0 && POPPLER_VERSION_MINOR < 71
+    static GBool abortCheck(void *data);
+#else
+    static bool abortCheck(void *data);
+#endif
+    static void AsyncTextWork(uv_work_t *req);
+    static void AsyncTextAfter(uv_work_t *req, int status);
+    static void runText(TextWork *work);
+    static v8::Local<v8::Value> textResult(TextWork *work);
+    static v8::Local<v8::Object> columnarResult(TextWork *work);
+    static v8::Local<v8::Array> boxesResult(const std::vector<TextBox> &boxes, bool withText);
+    void queueText(TextWork *work, v8::Local<v8::Object> pageHandle);
     static void AsyncRenderWork(uv_work_t *req);
     static void AsyncRenderAfter(uv_work_t *req, int status);
+    static void displayPreview(RenderWork *work, RenderContextPool::Context *ctx);
+    static void displayBands(RenderWork *work);
+    static void AsyncBandsWork(uv_work_t *req);
+    static void displayTiles(TileWork *work);
+    static void AsyncTilesWork(uv_work_t *req);
+    static void AsyncTilesAfter(uv_work_t *req, int status);
     void parseAnnot(const v8::Local<v8::Value> rect,
                     double *x1, double *y1,
                     double *x2, double *y2,
@@ -157,26 +347,10 @@ class NodePopplerPage : public Nan::ObjectWrap
   private:
     static NAN_GETTER(paramsGetter);
 
-    TextPage *getTextPage(bool rawOrder)
-    {
-        if (text == NULL)
-        {
-            TextOutputDev *textDev;
-            Gfx *gfx;
-            textDev = new TextOutputDev(NULL, true, 0, rawOrder, false);
-            gfx = pg->createGfx(textDev, 72., 72., 0,
-                                false,
-                                true,
-                                -1, -1, -1, -1,
-                                false, NULL, NULL);
-            pg->display(gfx);
-            textDev->endPage();
-            text = textDev->takeText();
-            delete gfx;
-            delete textDev;
-        }
-        return text;
-    }
+    TextPage *getTextPage(bool rawOrder);
+    void collectWords(bool rawOrder, std::vector<TextBox> &boxes);
+    void collectMatches(const unsigned int *ucs4, int len, std::vector<TextBox> &boxes);
+    void collectMatches(const std::vector<std::vector<Unicode>> &terms, std::vector<std::vector<TextBox>> &groups);
     void renderToStream(RenderWork *work);
     void addAnnot(const v8::Local<v8::Array> array, char **error);
 
@@ -184,7 +358,6 @@ class NodePopplerPage : public Nan::ObjectWrap
     PDFDoc *doc;
 
     Page *pg;
-    TextPage *text;
     double color_r;
     double color_g;
     double color_b;
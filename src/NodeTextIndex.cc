@@ -0,0 +1,139 @@
+#include <node_buffer.h>
+#include "NodeTextIndex.h"
+
+using namespace v8;
+using Nan::To;
+
+namespace node
+{
+Nan::Persistent<v8::Function> NodeTextIndex::constructor;
+
+NAN_MODULE_INIT(NodeTextIndex::Init)
+{
+    Local<FunctionTemplate> tpl = Nan::New<FunctionTemplate>(NodeTextIndex::New);
+    tpl->SetClassName(Nan::New<String>("TextIndex").ToLocalChecked());
+    tpl->InstanceTemplate()->SetInternalFieldCount(1);
+
+    Nan::SetAccessor(tpl->InstanceTemplate(),
+                     Nan::New<String>("pageCount").ToLocalChecked(),
+                     NodeTextIndex::paramsGetter);
+    Nan::SetAccessor(tpl->InstanceTemplate(),
+                     Nan::New<String>("wordCount").ToLocalChecked(),
+                     NodeTextIndex::paramsGetter);
+
+    Nan::SetPrototypeMethod(tpl, "search", NodeTextIndex::search);
+    Nan::SetPrototypeMethod(tpl, "serialize", NodeTextIndex::serialize);
+
+    constructor.Reset(Nan::GetFunction(tpl).ToLocalChecked());
+    Nan::Set(target,
+             Nan::New<String>("TextIndex").ToLocalChecked(),
+             Nan::GetFunction(tpl).ToLocalChecked());
+}
+
+Local<v8::Object> NodeTextIndex::NewInstance(TextIndex *index)
+{
+    Nan::EscapableHandleScope scope;
+    Local<Value> argv[] = {Nan::New<v8::External>(index)};
+    Local<v8::Object> obj = Nan::NewInstance(Nan::New(constructor), 1, argv).ToLocalChecked();
+    return scope.Escape(obj);
+}
+
+/**
+     * Javascript constructor
+     *
+     * \param data Buffer index returned by `serialize()`
+     */
+NAN_METHOD(NodeTextIndex::New)
+{
+    Nan::HandleScope scope;
+    TextIndex *index;
+
+    if (!info.IsConstructCall())
+    {
+        return Nan::ThrowError("Use the new operator to create instances of this object.");
+    }
+
+    if (info.Length() == 1 && info[0]->IsExternal())
+    {
+        index = static_cast<TextIndex *>(info[0].As<v8::External>()->Value());
+    }
+    else if (info.Length() == 1 && node::Buffer::HasInstance(info[0]))
+    {
+        Local<v8::Object> buffer = info[0].As<v8::Object>();
+        index = TextIndex::deserialize(node::Buffer::Data(buffer), node::Buffer::Length(buffer));
+        if (index == NULL)
+        {
+            return Nan::ThrowError("Invalid text index data");
+        }
+    }
+    else
+    {
+        return Nan::ThrowError("Arguments: (data: Buffer)");
+    }
+
+    NodeTextIndex *self = new NodeTextIndex(index);
+    self->Wrap(info.This());
+    info.GetReturnValue().Set(info.This());
+}
+
+NAN_GETTER(NodeTextIndex::paramsGetter)
+{
+    Nan::HandleScope scope;
+    Nan::Utf8String propName(property);
+    NodeTextIndex *self = Nan::ObjectWrap::Unwrap<NodeTextIndex>(info.This());
+
+    if (strcmp(*propName, "pageCount") == 0)
+    {
+        info.GetReturnValue().Set(Nan::New<Uint32>(self->index->getPageCount()));
+    }
+    else if (strcmp(*propName, "wordCount") == 0)
+    {
+        info.GetReturnValue().Set(Nan::New<Number>((double)self->index->getWordCount()));
+    }
+}
+
+/**
+     * \return Object Array of {page, x1, y1, x2, y2} for every occurrence
+     *                of the words of `query`, in document order
+     *
+     * \param query String word or phrase
+     */
+NAN_METHOD(NodeTextIndex::search)
+{
+    Nan::HandleScope scope;
+    NodeTextIndex *self = Nan::ObjectWrap::Unwrap<NodeTextIndex>(info.Holder());
+
+    if (info.Length() < 1 || !info[0]->IsString())
+    {
+        return Nan::ThrowError("One argument required: (query: String)");
+    }
+    Nan::Utf8String query(info[0]);
+
+    std::vector<TextIndex::Hit> hits = self->index->search(std::string(*query, query.length()));
+    Local<v8::Array> v8results = Nan::New<v8::Array>(hits.size());
+    for (size_t i = 0; i < hits.size(); i++)
+    {
+        const TextIndex::Hit &hit = hits[i];
+        Local<v8::Object> v8result = Nan::New<v8::Object>();
+        Nan::Set(v8result, Nan::New("page").ToLocalChecked(), Nan::New<Uint32>(hit.page));
+        Nan::Set(v8result, Nan::New("x1").ToLocalChecked(), Nan::New<Number>(hit.x1));
+        Nan::Set(v8result, Nan::New("x2").ToLocalChecked(), Nan::New<Number>(hit.x2));
+        Nan::Set(v8result, Nan::New("y1").ToLocalChecked(), Nan::New<Number>(hit.y1));
+        Nan::Set(v8result, Nan::New("y2").ToLocalChecked(), Nan::New<Number>(hit.y2));
+        Nan::Set(v8results, i, v8result);
+    }
+    info.GetReturnValue().Set(v8results);
+}
+
+/**
+     * \return Buffer index data for `new TextIndex(data)`
+     */
+NAN_METHOD(NodeTextIndex::serialize)
+{
+    Nan::HandleScope scope;
+    NodeTextIndex *self = Nan::ObjectWrap::Unwrap<NodeTextIndex>(info.Holder());
+    std::string data;
+    self->index->serialize(data);
+    info.GetReturnValue().Set(Nan::CopyBuffer(data.data(), data.length()).ToLocalChecked());
+}
+} // namespace node
@@ -0,0 +1,36 @@
+#include <v8.h>
+#include <node.h>
+#include <nan.h>
+#include <memory>
+
+#include "TextIndex.h"
+
+namespace node
+{
+/**
+ * JS wrapper of a TextIndex
+ */
+class NodeTextIndex : public Nan::ObjectWrap
+{
+  public:
+    static NAN_MODULE_INIT(Init);
+
+    /**
+     * Wraps `index`, taking ownership
+     */
+    static v8::Local<v8::Object> NewInstance(TextIndex *index);
+
+  protected:
+    static NAN_METHOD(New);
+    static NAN_METHOD(search);
+    static NAN_METHOD(serialize);
+
+  private:
+    explicit NodeTextIndex(TextIndex *index) : index(index) {}
+
+    static NAN_GETTER(paramsGetter);
+    static Nan::Persistent<v8::Function> constructor;
+
+    std::unique_ptr<TextIndex> index;
+};
+} // namespace node
@@ -0,0 +1,48 @@
+#include <nan.h>
+
+#include "ProgressQueue.h"
+
+ProgressQueue::ProgressQueue()
+{
+    uv_async_init(uv_default_loop(), &async, onPost);
+    async.data = this;
+}
+
+void ProgressQueue::post(std::function<void()> fn)
+{
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        pending.push_back(std::move(fn));
+    }
+    uv_async_send(&async);
+}
+
+void ProgressQueue::close()
+{
+    flush();
+    uv_close((uv_handle_t *)&async, onClose);
+}
+
+void ProgressQueue::flush()
+{
+    Nan::HandleScope scope;
+    std::vector<std::function<void()>> ready;
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        ready.swap(pending);
+    }
+    for (std::function<void()> &fn : ready)
+    {
+        fn();
+    }
+}
+
+void ProgressQueue::onPost(uv_async_t *handle)
+{
+    static_cast<ProgressQueue *>(handle->data)->flush();
+}
+
+void ProgressQueue::onClose(uv_handle_t *handle)
+{
+    delete static_cast<ProgressQueue *>(handle->data);
+}
@@ -0,0 +1,51 @@
+#ifndef __PROGRESS_QUEUE
+#define __PROGRESS_QUEUE
+#include <functional>
+#include <mutex>
+#include <vector>
+#include <uv.h>
+
+/**
+ * Hands partial results of a running render over to the main thread.
+ *
+ * A render thread posts closures, which run on the default loop in the
+ * order they were posted, while the render goes on. The owner calls close()
+ * from its after callback; anything still pending runs first.
+ */
+class ProgressQueue
+{
+public:
+    /**
+     * Must be called from the main thread.
+     */
+    ProgressQueue();
+
+    /**
+     * Queues `fn` to run on the main thread. Thread safe.
+     */
+    void post(std::function<void()> fn);
+
+    /**
+     * Runs pending closures and frees the queue once libuv is done with it.
+     * Must be called from the main thread, after the last post().
+     */
+    void close();
+
+    /**
+     * Makes the queue keep the process alive, or not. It does by default.
+     * Must be called from the main thread.
+     */
+    void ref() { uv_ref((uv_handle_t *)&async); }
+    void unref() { uv_unref((uv_handle_t *)&async); }
+
+private:
+    ~ProgressQueue() {}
+    void flush();
+    static void onPost(uv_async_t *handle);
+    static void onClose(uv_handle_t *handle);
+
+    std::mutex lock;
+    std::vector<std::function<void()>> pending;
+    uv_async_t async;
+};
+#endif
@@ -0,0 +1,234 @@
+#include <node_buffer.h>
+#include <chrono>
+
+#include "RangeLoader.h"
+
+RangeLoader::AbortScope::AbortScope(AbortCb shouldAbort)
+    : shouldAbort(shouldAbort), previous(currentAbortCb())
+{
+    currentAbortCb() = &this->shouldAbort;
+}
+
+RangeLoader::AbortScope::~AbortScope()
+{
+    currentAbortCb() = previous;
+}
+
+const RangeLoader::AbortCb *&RangeLoader::currentAbortCb()
+{
+    static thread_local const AbortCb *current = NULL;
+    return current;
+}
+
+RangeLoader::RangeLoader(v8::Local<v8::Function> read, size_t size)
+    : read(new Nan::Callback(read)), size(size), timeoutMs(60000), mainThread(uv_thread_self()), sync(new Sync())
+{
+    sync->queue = new ProgressQueue();
+    sync->inflight = 0;
+    // only reads in flight should keep the process alive
+    sync->queue->unref();
+}
+
+RangeLoader::~RangeLoader()
+{
+    // the JS callback and the queue belong to the main thread
+    Nan::Callback *cb = read;
+    std::shared_ptr<Sync> s = sync;
+    auto close = [cb, s]() {
+        ProgressQueue *q = s->queue;
+        s->queue = NULL;
+        q->close();
+        delete cb;
+    };
+    uv_thread_t self = uv_thread_self();
+    if (uv_thread_equal(&self, &mainThread))
+    {
+        close();
+    }
+    else
+    {
+        s->queue->post(close);
+    }
+}
+
+#if POPPLER_VERSION_MAJOR < 21
+size_t RangeLoader::init(GooString *url, CachedFile *cachedFile)
+#else
+size_t RangeLoader::init(CachedFile *cachedFile)
+#endif
+{
+    return size;
+}
+
+int RangeLoader::load(const std::vector<ByteRange> &ranges, CachedFileWriter *writer)
+{
+    uv_thread_t self = uv_thread_self();
+    if (uv_thread_equal(&self, &mainThread))
+    {
+        return -1;
+    }
+
+    std::vector<std::shared_ptr<Request>> requests;
+    Nan::Callback *cb = read;
+    for (const ByteRange &range : ranges)
+    {
+        // block aligned ranges may reach past the end of the document
+        size_t offset = range.offset;
+        size_t length = offset < size ? std::min((size_t)range.length, size - offset) : 0;
+        std::shared_ptr<Request> req(new Request{offset, length, std::vector<char>(), length == 0, false, false, sync});
+        requests.push_back(req);
+        if (length > 0)
+        {
+            sync->queue->post([cb, req]() { callRead(cb, req); });
+        }
+    }
+
+    // wake up now and then to check the timeout and the render's abort flag
+    const AbortCb *shouldAbort = currentAbortCb();
+    auto giveUp = std::chrono::steady_clock::now() + std::chrono::milliseconds(timeoutMs);
+    bool failed = false;
+    {
+        std::unique_lock<std::mutex> guard(sync->lock);
+        for (std::shared_ptr<Request> &req : requests)
+        {
+            while (!req->done && !failed)
+            {
+                if (std::chrono::steady_clock::now() >= giveUp || (shouldAbort && (*shouldAbort)()))
+                {
+                    failed = true;
+                    break;
+                }
+                sync->ready.wait_for(guard, std::chrono::milliseconds(50));
+            }
+            failed = failed || req->failed;
+        }
+        if (failed)
+        {
+            for (std::shared_ptr<Request> &req : requests)
+            {
+                req->done = true;
+            }
+        }
+    }
+    if (failed)
+    {
+        // reads still in flight no longer keep the process alive
+        for (std::shared_ptr<Request> &req : requests)
+        {
+            sync->queue->post([req]() { release(req.get()); });
+        }
+        return -1;
+    }
+
+    // the writer fills the cache blocks of the ranges in order
+    for (std::shared_ptr<Request> &req : requests)
+    {
+        writer->write(req->data.data(), req->data.size());
+    }
+    return 0;
+}
+
+/**
+ * Calls the JS read function on the main thread
+ */
+void RangeLoader::callRead(Nan::Callback *read, std::shared_ptr<Request> req)
+{
+    Sync *sync = req->sync.get();
+    {
+        std::lock_guard<std::mutex> guard(sync->lock);
+        if (req->done || sync->queue == NULL)
+        {
+            // the load gave up before the read was made
+            return;
+        }
+    }
+    req->inflight = true;
+    if (sync->inflight++ == 0)
+    {
+        sync->queue->ref();
+    }
+
+    Completion *completion = new Completion();
+    completion->req = req;
+    v8::Local<v8::Function> fn = Nan::GetFunction(
+        Nan::New<v8::FunctionTemplate>(onRead, Nan::New<v8::External>(completion))).ToLocalChecked();
+    completion->fn.Reset(fn);
+    completion->fn.SetWeak(completion, onCollected, Nan::WeakCallbackType::kParameter);
+
+    v8::Local<v8::Value> argv[] = {
+        Nan::New<v8::Number>((double)req->offset),
+        Nan::New<v8::Number>((double)req->length),
+        fn};
+    Nan::TryCatch try_catch;
+    Nan::AsyncResource res(Nan::New("poppler-simple::read-range").ToLocalChecked());
+    read->Call(3, argv, &res);
+    if (try_catch.HasCaught())
+    {
+        complete(req.get(), true, NULL, 0);
+    }
+}
+
+/**
+ * Hands the result of a read to the waiting thread. Main thread only.
+ */
+void RangeLoader::complete(Request *req, bool failed, const char *data, size_t len)
+{
+    {
+        std::lock_guard<std::mutex> guard(req->sync->lock);
+        // called back more than once, or after the load gave up
+        if (!req->done)
+        {
+            req->failed = failed || len != req->length;
+            if (!req->failed)
+            {
+                req->data.assign(data, data + len);
+            }
+            req->done = true;
+            req->sync->ready.notify_all();
+        }
+    }
+    release(req);
+}
+
+/**
+ * Stops a finished or abandoned read from keeping the process alive. Main thread only.
+ */
+void RangeLoader::release(Request *req)
+{
+    Sync *sync = req->sync.get();
+    if (!req->inflight)
+    {
+        return;
+    }
+    req->inflight = false;
+    if (--sync->inflight == 0 && sync->queue != NULL)
+    {
+        sync->queue->unref();
+    }
+}
+
+/**
+ * Callback of a JS read: (err, data: Buffer)
+ */
+NAN_METHOD(RangeLoader::onRead)
+{
+    Completion *completion = static_cast<Completion *>(info.Data().As<v8::External>()->Value());
+    Request *req = completion->req.get();
+    bool failed = info.Length() < 2 || !(info[0]->IsNull() || info[0]->IsUndefined()) ||
+                  !node::Buffer::HasInstance(info[1]);
+    if (failed)
+    {
+        complete(req, true, NULL, 0);
+    }
+    else
+    {
+        complete(req, false, node::Buffer::Data(info[1]), node::Buffer::Length(info[1]));
+    }
+}
+
+void RangeLoader::onCollected(const Nan::WeakCallbackInfo<Completion> &info)
+{
+    Completion *completion = info.GetParameter();
+    completion->fn.Reset();
+    delete completion;
+}
@@ -0,0 +1,111 @@
+#ifndef __RANGE_LOADER
+#define __RANGE_LOADER
+#include <condition_variable>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <vector>
+#include <nan.h>
+#include <cpp/poppler-version.h>
+#include <poppler/CachedFile.h>
+
+#include "ProgressQueue.h"
+
+/**
+ * Fetches parts of a document through a JS `read(offset, length, callback)`
+ * function, for documents that aren't local, e.g. in object storage.
+ *
+ * poppler's CachedFile asks for missing 8 KiB blocks and keeps every block
+ * it got, so a linearized document can show its first page after fetching
+ * only the blocks it needs. load() runs on the thread poppler reads from:
+ * it has the main thread call `read` for each range, all at once, and waits
+ * for the data. The main thread can't wait for itself, so there a load fails
+ * and poppler sees the data as missing.
+ *
+ * A load gives up after the read timeout, or once the AbortScope of its
+ * thread says so. Reads answered later are dropped.
+ */
+class RangeLoader : public CachedFileLoader
+{
+public:
+    typedef std::function<bool()> AbortCb;
+
+    /**
+     * Makes loads on the current thread give up once `shouldAbort` returns
+     * true, for as long as the scope lives.
+     */
+    class AbortScope
+    {
+    public:
+        AbortScope(AbortCb shouldAbort);
+        ~AbortScope();
+
+    private:
+        AbortCb shouldAbort;
+        const AbortCb *previous;
+    };
+
+    /**
+     * Must be called from the main thread.
+     */
+    RangeLoader(v8::Local<v8::Function> read, size_t size);
+    ~RangeLoader();
+
+    /**
+     * Sets how long a load waits for its reads, in milliseconds.
+     */
+    void setTimeout(unsigned int ms) { timeoutMs = ms; }
+
+#if POPPLER_VERSION_MAJOR < 21
+    size_t init(GooString *url, CachedFile *cachedFile) override;
+#else
+    size_t init(CachedFile *cachedFile) override;
+#endif
+    int load(const std::vector<ByteRange> &ranges, CachedFileWriter *writer) override;
+
+private:
+    // shared with the JS callbacks, which may outlive the loader
+    struct Sync
+    {
+        std::mutex lock;
+        std::condition_variable ready;
+        // main thread only: the queue, NULL once closed, and reads in flight
+        // keeping it referenced
+        ProgressQueue *queue;
+        int inflight;
+    };
+
+    struct Request
+    {
+        size_t offset;
+        size_t length;
+        std::vector<char> data;
+        // set with the sync lock held, by the main thread or a giving up load
+        bool done;
+        bool failed;
+        // main thread only
+        bool inflight;
+        std::shared_ptr<Sync> sync;
+    };
+
+    // JS callback of one read, freed once it is garbage collected
+    struct Completion
+    {
+        std::shared_ptr<Request> req;
+        Nan::Persistent<v8::Function> fn;
+    };
+
+    static const AbortCb *&currentAbortCb();
+    static void callRead(Nan::Callback *read, std::shared_ptr<Request> req);
+    static void complete(Request *req, bool failed, const char *data, size_t len);
+    static void release(Request *req);
+    static NAN_METHOD(onRead);
+    static void onCollected(const Nan::WeakCallbackInfo<Completion> &info);
+
+    Nan::Callback *read;
+    size_t size;
+    unsigned int timeoutMs;
+    uv_thread_t mainThread;
+    std::shared_ptr<Sync> sync;
+};
+#endif
@@ -0,0 +1,273 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <cpp/poppler-version.h>
+
+#include "RenderCache.h"
+#include "Sha256.h"
+
+static const char SPILL_MAGIC[4] = {'P', 'S', 'R', 'C'};
+
+std::mutex RenderCache::lock;
+std::list<RenderCache::Entry> RenderCache::entries;
+std::unordered_map<std::string, std::list<RenderCache::Entry>::iterator> RenderCache::index;
+size_t RenderCache::used = 0;
+size_t RenderCache::maxBytes = 0;
+std::string RenderCache::spillDir;
+uint64_t RenderCache::hits = 0;
+uint64_t RenderCache::misses = 0;
+
+void RenderCache::configure(size_t maxBytes, const std::string &spillDir)
+{
+    std::vector<Entry> spilled;
+    std::string dir;
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        RenderCache::maxBytes = maxBytes;
+        RenderCache::spillDir = spillDir;
+        dir = spillDir;
+        evict(spilled);
+    }
+    for (const Entry &entry : spilled)
+    {
+        spill(dir, entry);
+    }
+}
+
+void RenderCache::clear()
+{
+    std::lock_guard<std::mutex> guard(lock);
+    entries.clear();
+    index.clear();
+    used = 0;
+}
+
+bool RenderCache::enabled()
+{
+    std::lock_guard<std::mutex> guard(lock);
+    return maxBytes > 0 || !spillDir.empty();
+}
+
+RenderCache::Stats RenderCache::stats()
+{
+    std::lock_guard<std::mutex> guard(lock);
+    Stats s = {used, entries.size(), hits, misses};
+    return s;
+}
+
+char *RenderCache::get(const std::string &key, size_t *len)
+{
+    std::string dir;
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        auto it = index.find(key);
+        if (it != index.end())
+        {
+            entries.splice(entries.begin(), entries, it->second);
+            const std::vector<char> &data = it->second->data;
+            char *copy = (char *)malloc(data.size());
+            if (copy == NULL)
+            {
+                return NULL;
+            }
+            memcpy(copy, data.data(), data.size());
+            *len = data.size();
+            hits++;
+            return copy;
+        }
+        dir = spillDir;
+    }
+
+    char *data = dir.empty() ? NULL : load(dir, key, len);
+    std::lock_guard<std::mutex> guard(lock);
+    if (data == NULL)
+    {
+        misses++;
+        return NULL;
+    }
+    hits++;
+    if (*len <= maxBytes && index.find(key) == index.end())
+    {
+        // bring it back into memory, it is already on disk if dropped again
+        std::vector<Entry> spilled;
+        entries.push_front(Entry{key, std::vector<char>(data, data + *len)});
+        index[key] = entries.begin();
+        used += *len;
+        evict(spilled);
+    }
+    return data;
+}
+
+void RenderCache::put(const std::string &key, const char *data, size_t len)
+{
+    Entry entry{key, std::vector<char>(data, data + len)};
+    std::vector<Entry> spilled;
+    std::string dir;
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        dir = spillDir;
+        if (len > maxBytes)
+        {
+            spilled.push_back(std::move(entry));
+        }
+        else
+        {
+            auto it = index.find(key);
+            if (it != index.end())
+            {
+                // rendered concurrently, keep the newer one
+                used -= it->second->data.size();
+                entries.erase(it->second);
+                index.erase(it);
+            }
+            entries.push_front(std::move(entry));
+            index[key] = entries.begin();
+            used += len;
+            evict(spilled);
+        }
+    }
+    // disk writes don't hold up other renders
+    if (!dir.empty())
+    {
+        for (const Entry &e : spilled)
+        {
+            spill(dir, e);
+        }
+    }
+}
+
+/**
+ * Drops least recently used entries over the budget into `spilled`.
+ * Called with the lock held.
+ */
+void RenderCache::evict(std::vector<Entry> &spilled)
+{
+    while (used > maxBytes && !entries.empty())
+    {
+        Entry &last = entries.back();
+        used -= last.data.size();
+        index.erase(last.key);
+        if (!spillDir.empty())
+        {
+            spilled.push_back(std::move(last));
+        }
+        entries.pop_back();
+    }
+}
+
+std::string RenderCache::spillPath(const std::string &dir, const std::string &key)
+{
+    return dir + "/" + Sha256::hexDigest(key.data(), key.size()) + ".psrc";
+}
+
+/**
+ * Writes an entry to its file in `dir` unless it is there already.
+ * The file is written under a temporary name and renamed, so readers
+ * never see a partial image.
+ */
+void RenderCache::spill(const std::string &dir, const Entry &entry)
+{
+    std::string path = spillPath(dir, entry.key);
+    if (access(path.c_str(), F_OK) == 0)
+    {
+        return;
+    }
+    std::string tmp = path + ".XXXXXX";
+    std::vector<char> tmpName(tmp.begin(), tmp.end());
+    tmpName.push_back('\0');
+    int fd = mkstemp(tmpName.data());
+    if (fd == -1)
+    {
+        return;
+    }
+    FILE *f = fdopen(fd, "wb");
+    if (f == NULL)
+    {
+        close(fd);
+        unlink(tmpName.data());
+        return;
+    }
+    uint32_t keyLen = entry.key.size();
+    bool ok = fwrite(SPILL_MAGIC, 1, 4, f) == 4 &&
+              fwrite(&keyLen, 1, 4, f) == 4 &&
+              fwrite(entry.key.data(), 1, keyLen, f) == keyLen &&
+              fwrite(entry.data.data(), 1, entry.data.size(), f) == entry.data.size();
+    ok = fclose(f) == 0 && ok;
+    if (!ok || rename(tmpName.data(), path.c_str()) != 0)
+    {
+        unlink(tmpName.data());
+    }
+}
+
+/**
+ * Reads a spilled image, checking that the file was written for `key`.
+ */
+char *RenderCache::load(const std::string &dir, const std::string &key, size_t *len)
+{
+    FILE *f = fopen(spillPath(dir, key).c_str(), "rb");
+    if (f == NULL)
+    {
+        return NULL;
+    }
+    char *data = NULL;
+    char magic[4];
+    uint32_t keyLen;
+    long size;
+    if (fread(magic, 1, 4, f) == 4 && memcmp(magic, SPILL_MAGIC, 4) == 0 &&
+        fread(&keyLen, 1, 4, f) == 4 && keyLen == key.size() &&
+        fseek(f, 0, SEEK_END) == 0 && (size = ftell(f)) >= (long)(8 + keyLen))
+    {
+        std::vector<char> fileKey(keyLen);
+        *len = size - 8 - keyLen;
+        fseek(f, 8, SEEK_SET);
+        if (fread(fileKey.data(), 1, keyLen, f) == keyLen &&
+            memcmp(fileKey.data(), key.data(), keyLen) == 0 &&
+            (data = (char *)malloc(*len > 0 ? *len : 1)) != NULL &&
+            fread(data, 1, *len, f) != *len)
+        {
+            free(data);
+            data = NULL;
+        }
+    }
+    fclose(f);
+    return data;
+}
+
+std::string RenderCache::contentId(BaseStream *str)
+{
+    Sha256 sha;
+    size_t total = 0;
+    std::vector<char> chunk(1 << 20);
+    str->reset();
+#if POPPLER_VERSION_MAJOR == 0 && POPPLER_VERSION_MINOR < 21
+    size_t n = 0;
+    int c;
+    while ((c = str->getChar()) != EOF)
+    {
+        chunk[n++] = (char)c;
+        if (n == chunk.size())
+        {
+            sha.update(chunk.data(), n);
+            total += n;
+            n = 0;
+        }
+    }
+    sha.update(chunk.data(), n);
+    total += n;
+#else
+    // whole blocks at a time instead of a virtual call per byte
+    int n;
+    while ((n = str->doGetChars((int)chunk.size(), (unsigned char *)chunk.data())) > 0)
+    {
+        sha.update(chunk.data(), n);
+        total += n;
+    }
+#endif
+    return sha.hexDigest() + ":" + std::to_string(total);
+}
+
+std::string RenderCache::contentId(const char *data, size_t len)
+{
+    return Sha256::hexDigest(data, len) + ":" + std::to_string(len);
+}
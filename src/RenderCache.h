@@ -0,0 +1,90 @@
+#ifndef __RENDER_CACHE
+#define __RENDER_CACHE
+#include <stdint.h>
+#include <list>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include <poppler/Stream.h>
+
+/**
+ * Process wide cache of encoded renders.
+ *
+ * Keys are built from the SHA-256 digest and length of the document data,
+ * so documents opened more than once, from a file or from a buffer, share
+ * their entries, and a crafted document can't take over another's. Up to
+ * `maxBytes` of images are kept in memory, least recently used first out.
+ * With a spill directory, images dropped from memory (or larger than the
+ * budget) are written there as one file per key and looked up on a memory
+ * miss. Spilled files are never removed, the directory belongs to the caller
+ * and may be shared by several processes.
+ *
+ * Disabled until configure() is called with a budget or a directory.
+ */
+class RenderCache
+{
+public:
+    struct Stats
+    {
+        size_t bytes;
+        size_t entries;
+        uint64_t hits;
+        uint64_t misses;
+    };
+
+    /**
+     * Sets the memory budget and spill directory ("" for none), dropping
+     * what doesn't fit. Thread safe.
+     */
+    static void configure(size_t maxBytes, const std::string &spillDir);
+
+    /**
+     * Drops all entries kept in memory. Thread safe.
+     */
+    static void clear();
+
+    static bool enabled();
+    static Stats stats();
+
+    /**
+     * \return malloc'ed copy of the cached image and its length in `len`,
+     *         or NULL on a miss. Thread safe.
+     */
+    static char *get(const std::string &key, size_t *len);
+
+    /**
+     * Caches a copy of `len` bytes at `data`. Thread safe.
+     */
+    static void put(const std::string &key, const char *data, size_t len);
+
+    /**
+     * Identifies the data of a stream, from its start: its SHA-256 digest
+     * in hex and its length.
+     */
+    static std::string contentId(BaseStream *str);
+    static std::string contentId(const char *data, size_t len);
+
+private:
+    struct Entry
+    {
+        std::string key;
+        std::vector<char> data;
+    };
+
+    static void evict(std::vector<Entry> &spilled);
+    static std::string spillPath(const std::string &dir, const std::string &key);
+    static void spill(const std::string &dir, const Entry &entry);
+    static char *load(const std::string &dir, const std::string &key, size_t *len);
+
+    static std::mutex lock;
+    // most recently used first
+    static std::list<Entry> entries;
+    static std::unordered_map<std::string, std::list<Entry>::iterator> index;
+    static size_t used;
+    static size_t maxBytes;
+    static std::string spillDir;
+    static uint64_t hits;
+    static uint64_t misses;
+};
+#endif
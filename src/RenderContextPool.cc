@@ -0,0 +1,230 @@
+#include <string.h>
+
+#include "RenderContextPool.h"
+#include "RenderCache.h"
+#include "RenderPool.h"
+
+RenderContextPool::RenderContextPool(PDFDoc *doc, GooString *ownerPassword, GooString *userPassword, bool streamed)
+    : doc(doc), hasOwnerPassword(ownerPassword != NULL), hasUserPassword(userPassword != NULL),
+      modified(false), streamed(streamed), mutableSource(false), data(NULL), dataLength(0)
+{
+#if POPPLER_VERSION_MAJOR == 0 && POPPLER_VERSION_MINOR < 72
+    if (ownerPassword)
+        this->ownerPassword = ownerPassword->getCString();
+    if (userPassword)
+        this->userPassword = userPassword->getCString();
+#else
+    if (ownerPassword)
+        this->ownerPassword = ownerPassword->c_str();
+    if (userPassword)
+        this->userPassword = userPassword->c_str();
+#endif
+    // BaseStream::copy appeared in poppler 0.21
+#if POPPLER_VERSION_MAJOR == 0 && POPPLER_VERSION_MINOR < 21
+    useClones = false;
+#else
+    useClones = !streamed;
+#endif
+}
+
+RenderContextPool::~RenderContextPool()
+{
+    for (Context *ctx : idle)
+    {
+        destroy(ctx);
+    }
+}
+
+/**
+ * Opens the document once more over a copy of its base stream. Copies share
+ * the underlying file or memory and only keep their own position.
+ */
+PDFDoc *RenderContextPool::cloneDoc()
+{
+#if POPPLER_VERSION_MAJOR == 0 && POPPLER_VERSION_MINOR < 21
+    return NULL;
+#else
+    BaseStream *str = doc->getBaseStream()->copy();
+    if (str == NULL)
+    {
+        return NULL;
+    }
+#if ((POPPLER_VERSION_MAJOR == 22) && (POPPLER_VERSION_MINOR >= 3)) || POPPLER_VERSION_MAJOR > 22
+    std::optional<GooString> ownerPW, userPW;
+    if (hasOwnerPassword)
+    {
+        ownerPW = GooString(ownerPassword.c_str());
+    }
+    if (hasUserPassword)
+    {
+        userPW = GooString(userPassword.c_str());
+    }
+    PDFDoc *clone = new PDFDoc(str, ownerPW, userPW);
+#else
+    GooString *ownerPW = hasOwnerPassword ? new GooString(ownerPassword.c_str()) : NULL;
+    GooString *userPW = hasUserPassword ? new GooString(userPassword.c_str()) : NULL;
+    PDFDoc *clone = new PDFDoc(str, ownerPW, userPW);
+    delete ownerPW;
+    delete userPW;
+#endif
+    if (!clone->isOk())
+    {
+        delete clone;
+        return NULL;
+    }
+    return clone;
+#endif
+}
+
+RenderContextPool::Context *RenderContextPool::acquire(SplashColorMode mode, const unsigned char *paper)
+{
+    static const unsigned char white[3] = {255, 255, 255};
+    if (paper == NULL)
+    {
+        paper = white;
+    }
+    bool sharedDoc = !useClones;
+    if (sharedDoc)
+    {
+        // held until release()
+        shared.lock();
+    }
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        for (size_t i = idle.size(); i > 0; i--)
+        {
+            Context *ctx = idle[i - 1];
+            if (ctx->mode == mode && memcmp(ctx->paper, paper, 3) == 0 && ctx->shared == sharedDoc)
+            {
+                idle.erase(idle.begin() + (i - 1));
+                return ctx;
+            }
+        }
+    }
+
+    PDFDoc *target = doc;
+    if (!sharedDoc)
+    {
+        target = cloneDoc();
+        if (target == NULL)
+        {
+            // the stream can't be reopened, fall back to the shared document
+            useClones = false;
+            sharedDoc = true;
+            shared.lock();
+            target = doc;
+        }
+    }
+
+    SplashColor paperColor;
+    if (mode == splashModeMono8 || mode == splashModeMono1)
+    {
+        // gray paper of the same luminance, black or white for bilevel output
+        int luma = (paper[0] * 299 + paper[1] * 587 + paper[2] * 114) / 1000;
+        paperColor[0] = mode == splashModeMono1 ? (luma >= 128 ? 255 : 0) : luma;
+    }
+    else
+    {
+        paperColor[0] = paper[0];
+        paperColor[1] = paper[1];
+        paperColor[2] = paper[2];
+    }
+    Context *ctx = new Context();
+    ctx->doc = target;
+    ctx->out = new SplashOutputDev(
+        mode,
+        4, false,
+        paperColor);
+    ctx->out->startDoc(target);
+    ctx->mode = mode;
+    memcpy(ctx->paper, paper, 3);
+    ctx->shared = sharedDoc;
+    return ctx;
+}
+
+void RenderContextPool::release(Context *ctx)
+{
+    // Drop the page bitmap so idle contexts hold only font state
+    delete ctx->out->takeBitmap();
+    bool sharedDoc = ctx->shared;
+
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        if (!sharedDoc && !useClones)
+        {
+            // the clone predates a change of the shared document
+            destroy(ctx);
+        }
+        else
+        {
+            // One warm context per thread that may render concurrently
+            if (idle.size() >= RenderPool::getConcurrency())
+            {
+                // Evict the least recently used context
+                destroy(idle.front());
+                idle.erase(idle.begin());
+            }
+            idle.push_back(ctx);
+        }
+    }
+
+    if (sharedDoc)
+    {
+        shared.unlock();
+    }
+}
+
+void RenderContextPool::invalidate()
+{
+    useClones = false;
+    modified = true;
+    std::lock_guard<std::mutex> guard(lock);
+    for (size_t i = idle.size(); i > 0; i--)
+    {
+        if (!idle[i - 1]->shared)
+        {
+            destroy(idle[i - 1]);
+            idle.erase(idle.begin() + (i - 1));
+        }
+    }
+}
+
+void RenderContextPool::destroy(Context *ctx)
+{
+    // the output device refers to the document
+    delete ctx->out;
+    if (!ctx->shared)
+    {
+        delete ctx->doc;
+    }
+    delete ctx;
+}
+
+const std::string &RenderContextPool::contentId()
+{
+    std::call_once(idOnce, [this]() {
+        if (data != NULL)
+        {
+            id = RenderCache::contentId(data, dataLength);
+            return;
+        }
+#if POPPLER_VERSION_MAJOR == 0 && POPPLER_VERSION_MINOR < 21
+        std::lock_guard<std::mutex> guard(shared);
+        id = RenderCache::contentId(doc->getBaseStream());
+#else
+        // read through a copy, so the shared stream's position is left alone
+        BaseStream *str = doc->getBaseStream()->copy();
+        if (str == NULL)
+        {
+            std::lock_guard<std::mutex> guard(shared);
+            id = RenderCache::contentId(doc->getBaseStream());
+        }
+        else
+        {
+            id = RenderCache::contentId(str);
+            delete str;
+        }
+#endif
+    });
+    return id;
+}
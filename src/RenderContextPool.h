@@ -0,0 +1,133 @@
+#ifndef __RENDER_CONTEXT_POOL
+#define __RENDER_CONTEXT_POOL
+#include <atomic>
+#include <mutex>
+#include <stdint.h>
+#include <string>
+#include <vector>
+#include <poppler/PDFDoc.h>
+#include <poppler/SplashOutputDev.h>
+
+/**
+ * Per-document pool of render contexts.
+ *
+ * PDFDoc, its XRef and Page objects cache parsed objects and are not thread
+ * safe, so each context renders its own clone of the document, opened over
+ * a copy of the shared, read-only base stream. Any number of pages of one
+ * document can then be rendered in parallel.
+ *
+ * SplashOutputDev::startDoc builds font engine state and glyphs are cached
+ * per output device, so contexts are kept warm between renders of the same
+ * document instead of being recreated for every page.
+ *
+ * Clones don't see changes made through the shared document. Once its
+ * annotations are modified (or when the stream can't be copied), every
+ * render uses the shared document and renders are serialised by sharedLock().
+ *
+ * Documents fetched on demand (`streamed`) always use the shared document:
+ * copies of their stream would share one read position and one block cache.
+ */
+class RenderContextPool
+{
+public:
+    struct Context
+    {
+        // clone of the document, or the shared document itself
+        PDFDoc *doc;
+        SplashOutputDev *out;
+        SplashColorMode mode;
+        // RGB paper color
+        unsigned char paper[3];
+        bool shared;
+    };
+
+    RenderContextPool(PDFDoc *doc, GooString *ownerPassword, GooString *userPassword, bool streamed = false);
+    ~RenderContextPool();
+
+    /**
+     * Takes an idle context rendering in `mode` on `paper` (RGB, white if NULL)
+     * or creates a new one. Thread safe.
+     */
+    Context *acquire(SplashColorMode mode, const unsigned char *paper = NULL);
+
+    /**
+     * Returns an acquired context to the pool. Thread safe.
+     */
+    void release(Context *ctx);
+
+    /**
+     * Makes all later renders use the shared document. Call with sharedLock()
+     * held after changing the shared document.
+     */
+    void invalidate();
+
+    /**
+     * Tells whether the shared document was changed since it was opened.
+     */
+    bool isModified() { return modified; }
+
+    /**
+     * Tells whether the document data is fetched on demand, so hashing it
+     * would mean fetching all of it.
+     */
+    bool isStreamed() { return streamed; }
+
+    /**
+     * SHA-256 digest and length of the document data, \see RenderCache::contentId.
+     * Computed on first use. Thread safe.
+     */
+    const std::string &contentId();
+
+    /**
+     * Marks the document data as memory its owner can still change: a Buffer
+     * opened without copying or a shared mapping of a file. Renders of such a
+     * document aren't cached, as the data may no longer match its contentId().
+     */
+    void setMutableSource() { mutableSource = true; }
+    bool hasMutableSource() { return mutableSource; }
+
+    /**
+     * Lets contentId() digest the document data in memory instead of reading
+     * the stream. Call before the first contentId().
+     */
+    void setContentData(const char *data, size_t len)
+    {
+        this->data = data;
+        dataLength = len;
+    }
+
+    /**
+     * Opens a private copy of the document for a worker thread, or returns
+     * NULL if the shared document must be used. The caller deletes it.
+     */
+    PDFDoc *openClone() { return useClones ? cloneDoc() : NULL; }
+
+    /**
+     * Guards the shared document.
+     */
+    std::mutex &sharedLock() { return shared; }
+
+private:
+    PDFDoc *cloneDoc();
+    void destroy(Context *ctx);
+
+    // we doesn't own this
+    PDFDoc *doc;
+    bool hasOwnerPassword;
+    bool hasUserPassword;
+    std::string ownerPassword;
+    std::string userPassword;
+    std::atomic<bool> useClones;
+    std::atomic<bool> modified;
+    bool streamed;
+    bool mutableSource;
+    // document data in memory, if any, we doesn't own this
+    const char *data;
+    size_t dataLength;
+    std::once_flag idOnce;
+    std::string id;
+    std::mutex shared;
+    std::mutex lock;
+    std::vector<Context *> idle;
+};
+#endif
@@ -0,0 +1,142 @@
+#include <thread>
+#include "RenderPool.h"
+
+RenderPool *RenderPool::instance = NULL;
+const std::chrono::milliseconds RenderPool::AGING_INTERVAL(500);
+std::atomic<size_t> RenderPool::concurrency(
+    std::thread::hardware_concurrency() > 0 ? std::thread::hardware_concurrency() : 4);
+
+RenderPool::RenderPool() : threads(0), outstanding(0)
+{
+    uv_async_init(uv_default_loop(), &async, onDone);
+    async.data = this;
+    // only pending renders should keep the process alive
+    uv_unref((uv_handle_t *)&async);
+}
+
+void RenderPool::queue(uv_work_t *req, WorkCb work, AfterCb after, Priority priority)
+{
+    // Created on first use and never destroyed: detached threads may still
+    // wait on its condition variable while the process exits
+    if (instance == NULL)
+    {
+        instance = new RenderPool();
+        instance->resize();
+    }
+    RenderPool *pool = instance;
+    if (pool->outstanding++ == 0)
+    {
+        uv_ref((uv_handle_t *)&pool->async);
+    }
+    {
+        std::lock_guard<std::mutex> guard(pool->lock);
+        pool->pending[priority].push_back(Task{req, work, after, std::chrono::steady_clock::now()});
+    }
+    pool->wake.notify_one();
+}
+
+void RenderPool::setConcurrency(size_t n)
+{
+    concurrency = n;
+    if (instance != NULL)
+    {
+        instance->resize();
+    }
+}
+
+size_t RenderPool::getConcurrency()
+{
+    return concurrency;
+}
+
+void RenderPool::resize()
+{
+    std::lock_guard<std::mutex> guard(lock);
+    while (threads < concurrency)
+    {
+        threads++;
+        std::thread(&RenderPool::run, this).detach();
+    }
+    // surplus threads exit once they are idle
+    wake.notify_all();
+}
+
+void RenderPool::run()
+{
+    std::unique_lock<std::mutex> guard(lock);
+    while (true)
+    {
+        wake.wait(guard, [this] { return threads > concurrency || hasPending(); });
+        if (threads > concurrency)
+        {
+            threads--;
+            return;
+        }
+        Task task = next();
+        guard.unlock();
+        task.work(task.req);
+        guard.lock();
+        done.push_back(task);
+        uv_async_send(&async);
+    }
+}
+
+bool RenderPool::hasPending()
+{
+    for (int level = 0; level < P_LEVELS; level++)
+    {
+        if (!pending[level].empty())
+            return true;
+    }
+    return false;
+}
+
+/**
+ * Takes the oldest task of the highest non-empty level. Called with the lock held.
+ */
+RenderPool::Task RenderPool::next()
+{
+    auto now = std::chrono::steady_clock::now();
+    // aged tasks stop at P_NORMAL, P_HIGH stays ahead of any backlog
+    for (int level = P_NORMAL + 1; level < P_LEVELS; level++)
+    {
+        // queues are FIFO, so only the front may have waited long enough
+        while (!pending[level].empty() && now - pending[level].front().queued >= AGING_INTERVAL)
+        {
+            Task aged = pending[level].front();
+            pending[level].pop_front();
+            aged.queued = now;
+            pending[level - 1].push_back(aged);
+        }
+    }
+    for (int level = 0; level < P_LEVELS; level++)
+    {
+        if (!pending[level].empty())
+        {
+            Task task = pending[level].front();
+            pending[level].pop_front();
+            return task;
+        }
+    }
+    // unreachable, run() waits for hasPending()
+    return Task();
+}
+
+void RenderPool::onDone(uv_async_t *handle)
+{
+    RenderPool *pool = static_cast<RenderPool *>(handle->data);
+    std::vector<Task> finished;
+    {
+        std::lock_guard<std::mutex> guard(pool->lock);
+        finished.swap(pool->done);
+    }
+    for (Task &task : finished)
+    {
+        task.after(task.req, 0);
+    }
+    pool->outstanding -= finished.size();
+    if (pool->outstanding == 0)
+    {
+        uv_unref((uv_handle_t *)&pool->async);
+    }
+}
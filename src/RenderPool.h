@@ -0,0 +1,83 @@
+#ifndef __RENDER_POOL
+#define __RENDER_POOL
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <vector>
+#include <uv.h>
+
+/**
+ * Process wide pool of render threads.
+ *
+ * Renders are CPU bound and long, so they get their own threads instead of
+ * occupying libuv's threadpool, which is shared with fs, dns and zlib.
+ * Completion callbacks run on the default loop, like with uv_queue_work.
+ *
+ * Queued renders are taken by priority. A render that waited longer than
+ * AGING_INTERVAL moves up one level, up to P_NORMAL, so low priority work
+ * can't starve behind normal renders and never delays high priority ones.
+ */
+class RenderPool
+{
+public:
+    typedef void (*WorkCb)(uv_work_t *req);
+    typedef void (*AfterCb)(uv_work_t *req, int status);
+
+    enum Priority
+    {
+        P_HIGH,
+        P_NORMAL,
+        P_LOW,
+        P_LEVELS
+    };
+
+    /**
+     * Drop-in replacement for uv_queue_work(uv_default_loop(), ...).
+     * Must be called from the main thread.
+     */
+    static void queue(uv_work_t *req, WorkCb work, AfterCb after, Priority priority = P_NORMAL);
+
+    /**
+     * Sets the number of render threads. Must be called from the main thread.
+     */
+    static void setConcurrency(size_t n);
+
+    /**
+     * Number of render threads. Thread safe.
+     */
+    static size_t getConcurrency();
+
+private:
+    struct Task
+    {
+        uv_work_t *req;
+        WorkCb work;
+        AfterCb after;
+        std::chrono::steady_clock::time_point queued;
+    };
+
+    static const std::chrono::milliseconds AGING_INTERVAL;
+
+    RenderPool();
+    void resize();
+    void run();
+    bool hasPending();
+    Task next();
+    static void onDone(uv_async_t *handle);
+
+    static RenderPool *instance;
+    static std::atomic<size_t> concurrency;
+
+    std::mutex lock;
+    std::condition_variable wake;
+    std::deque<Task> pending[P_LEVELS];
+    std::vector<Task> done;
+    // started threads that haven't exited yet
+    size_t threads;
+    // queued tasks whose after callback hasn't run yet, main thread only
+    size_t outstanding;
+    uv_async_t async;
+};
+#endif
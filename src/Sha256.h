@@ -0,0 +1,33 @@
+#ifndef __SHA256
+#define __SHA256
+#include <stddef.h>
+#include <stdint.h>
+#include <string>
+
+/**
+ * SHA-256 (FIPS 180-4), for content addressed cache keys that must not
+ * collide on purpose.
+ */
+class Sha256
+{
+public:
+    Sha256();
+
+    void update(const void *data, size_t len);
+
+    /**
+     * Finishes the digest, as 64 lowercase hex digits. Call once.
+     */
+    std::string hexDigest();
+
+    static std::string hexDigest(const void *data, size_t len);
+
+private:
+    void block(const unsigned char *p);
+
+    uint32_t state[8];
+    unsigned char buffer[64];
+    size_t buffered;
+    uint64_t total;
+};
+#endif
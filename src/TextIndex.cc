@@ -0,0 +1,226 @@
+#include <algorithm>
+#include <ctype.h>
+#include <memory>
+#include <string.h>
+#include <poppler/UnicodeTypeTable.h>
+#include "TextIndex.h"
+
+namespace
+{
+const char MAGIC[4] = {'P', 'S', 'T', 'I'};
+const uint32_t VERSION = 1;
+
+/**
+ * Decodes UTF-8, replacing malformed sequences with U+FFFD
+ */
+void decodeUtf8(const std::string &s, std::vector<Unicode> &out)
+{
+    size_t i = 0;
+    while (i < s.length())
+    {
+        unsigned char c = s[i];
+        int extra = c < 0x80 ? 0 : (c >> 5) == 0x6 ? 1 : (c >> 4) == 0xe ? 2 : (c >> 3) == 0x1e ? 3 : -1;
+        Unicode u = extra == 0 ? c : extra == 1 ? (c & 0x1f) : extra == 2 ? (c & 0x0f) : (c & 0x07);
+        i++;
+        for (int k = 0; k < extra && i < s.length() && ((unsigned char)s[i] >> 6) == 0x2; k++, i++)
+        {
+            u = (u << 6) | ((unsigned char)s[i] & 0x3f);
+            if (k == extra - 1)
+                extra = 0;
+        }
+        out.push_back(extra == 0 ? u : 0xfffd);
+    }
+}
+
+bool isSpace(Unicode u)
+{
+    return u == ' ' || (u >= '\t' && u <= '\r') || u == 0xa0 || u == 0x3000;
+}
+
+bool isPunct(Unicode u)
+{
+    return u < 0x80 ? ispunct((int)u) != 0 : (u >= 0x2010 && u <= 0x205e) || u == 0xab || u == 0xbb;
+}
+
+template <typename T>
+void put(std::string &out, T value)
+{
+    out.append((const char *)&value, sizeof(value));
+}
+
+template <typename T>
+bool get(const char *&p, const char *end, T *value)
+{
+    if ((size_t)(end - p) < sizeof(T))
+        return false;
+    memcpy(value, p, sizeof(T));
+    p += sizeof(T);
+    return true;
+}
+} // namespace
+
+/**
+ * Splits `text` into terms: words without surrounding punctuation, upper
+ * cased code points stored as raw UCS-4 bytes. Without `split` the whole
+ * text is one word.
+ */
+void TextIndex::terms(const std::string &text, std::vector<std::string> &out, bool split)
+{
+    std::vector<Unicode> chars;
+    decodeUtf8(text, chars);
+    size_t i = 0;
+    while (i <= chars.size())
+    {
+        size_t start = i;
+        while (i < chars.size() && !(split && isSpace(chars[i])))
+            i++;
+        size_t end = i;
+        while (start < end && isPunct(chars[start]))
+            start++;
+        while (end > start && isPunct(chars[end - 1]))
+            end--;
+        if (end > start || !split)
+        {
+            std::string term;
+            for (size_t k = start; k < end; k++)
+            {
+                Unicode u = unicodeToUpper(chars[k]);
+                term.append((const char *)&u, sizeof(u));
+            }
+            out.push_back(term);
+        }
+        i++;
+    }
+}
+
+void TextIndex::addWord(uint32_t page, const std::string &text, double x1, double y1, double x2, double y2)
+{
+    std::vector<std::string> t;
+    terms(text, t, false);
+    uint32_t id = entries.size();
+    entries.push_back(Entry{page, (float)x1, (float)y1, (float)x2, (float)y2});
+    // punctuation-only words still take a position, so phrases can't span them
+    if (!t[0].empty())
+    {
+        postings[t[0]].push_back(id);
+    }
+}
+
+std::vector<TextIndex::Hit> TextIndex::search(const std::string &query) const
+{
+    std::vector<Hit> hits;
+    std::vector<std::string> t;
+    terms(query, t, true);
+    if (t.empty())
+        return hits;
+
+    std::vector<const std::vector<uint32_t> *> lists;
+    for (const std::string &term : t)
+    {
+        auto it = postings.find(term);
+        if (it == postings.end())
+            return hits;
+        lists.push_back(&it->second);
+    }
+
+    for (uint32_t id : *lists[0])
+    {
+        Hit hit = entries[id];
+        bool match = true;
+        for (size_t k = 1; k < lists.size() && match; k++)
+        {
+            uint32_t next = id + k;
+            match = next < entries.size() && entries[next].page == hit.page &&
+                    std::binary_search(lists[k]->begin(), lists[k]->end(), next);
+            if (match)
+            {
+                const Entry &e = entries[next];
+                hit.x1 = std::min(hit.x1, e.x1);
+                hit.y1 = std::min(hit.y1, e.y1);
+                hit.x2 = std::max(hit.x2, e.x2);
+                hit.y2 = std::max(hit.y2, e.y2);
+            }
+        }
+        if (match)
+            hits.push_back(hit);
+    }
+    return hits;
+}
+
+/**
+ * Layout, in native byte order: "PSTI", version, page count, entry count,
+ * entries (page, x1, y1, x2, y2), term count, then per term its byte length,
+ * bytes, entry count and sorted entry numbers.
+ */
+void TextIndex::serialize(std::string &out) const
+{
+    out.append(MAGIC, sizeof(MAGIC));
+    put<uint32_t>(out, VERSION);
+    put<uint32_t>(out, pageCount);
+    put<uint32_t>(out, entries.size());
+    for (const Entry &e : entries)
+    {
+        put(out, e.page);
+        put(out, e.x1);
+        put(out, e.y1);
+        put(out, e.x2);
+        put(out, e.y2);
+    }
+    put<uint32_t>(out, postings.size());
+    for (auto &p : postings)
+    {
+        put<uint32_t>(out, p.first.length());
+        out.append(p.first);
+        put<uint32_t>(out, p.second.size());
+        out.append((const char *)p.second.data(), p.second.size() * sizeof(uint32_t));
+    }
+}
+
+TextIndex *TextIndex::deserialize(const char *data, size_t length)
+{
+    const char *p = data;
+    const char *end = data + length;
+    uint32_t version, entryCount, termCount;
+    std::unique_ptr<TextIndex> index(new TextIndex());
+
+    if (length < sizeof(MAGIC) || memcmp(p, MAGIC, sizeof(MAGIC)) != 0)
+        return NULL;
+    p += sizeof(MAGIC);
+    if (!get(p, end, &version) || version != VERSION ||
+        !get(p, end, &index->pageCount) || !get(p, end, &entryCount))
+        return NULL;
+    // 20 bytes per entry
+    if ((size_t)(end - p) / 20 < entryCount)
+        return NULL;
+    index->entries.resize(entryCount);
+    for (Entry &e : index->entries)
+    {
+        get(p, end, &e.page);
+        get(p, end, &e.x1);
+        get(p, end, &e.y1);
+        get(p, end, &e.x2);
+        get(p, end, &e.y2);
+    }
+    if (!get(p, end, &termCount))
+        return NULL;
+    for (uint32_t i = 0; i < termCount; i++)
+    {
+        uint32_t keyLength, count;
+        if (!get(p, end, &keyLength) || (size_t)(end - p) < keyLength)
+            return NULL;
+        std::vector<uint32_t> &ids = index->postings[std::string(p, keyLength)];
+        p += keyLength;
+        if (!get(p, end, &count) || (size_t)(end - p) / sizeof(uint32_t) < count)
+            return NULL;
+        ids.resize(count);
+        memcpy(ids.data(), p, count * sizeof(uint32_t));
+        p += count * sizeof(uint32_t);
+        for (uint32_t k = 0; k < count; k++)
+        {
+            // search() relies on sorted, valid entry numbers
+            if (ids[k] >= entryCount || (k > 0 && ids[k] <= ids[k - 1]))
+                return NULL;
+        }
+    }
+    return p == end ? index.release() : NULL;
+}
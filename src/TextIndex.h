@@ -0,0 +1,62 @@
+#ifndef __TEXT_INDEX
+#define __TEXT_INDEX
+#include <stdint.h>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+/**
+ * Inverted index of the words of a document.
+ *
+ * Every word occurrence is an entry (page, bbox) numbered in reading order;
+ * each case-folded term maps to the sorted numbers of its entries. A phrase
+ * matches when its terms occupy consecutive entries of one page.
+ *
+ * Not thread safe for writing; search() may run concurrently.
+ */
+class TextIndex
+{
+public:
+    struct Hit
+    {
+        // 1-based page number
+        uint32_t page;
+        // relative coordinates, as returned by NodePopplerPage::getWordList
+        float x1;
+        float y1;
+        float x2;
+        float y2;
+    };
+
+    TextIndex() : pageCount(0) {}
+
+    /**
+     * Appends a word. Words must be added page by page in reading order.
+     */
+    void addWord(uint32_t page, const std::string &text, double x1, double y1, double x2, double y2);
+    void setPageCount(uint32_t count) { pageCount = count; }
+    uint32_t getPageCount() const { return pageCount; }
+    size_t getWordCount() const { return entries.size(); }
+
+    /**
+     * Finds whole words or phrases, ignoring case and surrounding punctuation.
+     */
+    std::vector<Hit> search(const std::string &query) const;
+
+    void serialize(std::string &out) const;
+
+    /**
+     * \return NULL if `data` is not a valid serialized index
+     */
+    static TextIndex *deserialize(const char *data, size_t length);
+
+private:
+    typedef Hit Entry;
+
+    static void terms(const std::string &text, std::vector<std::string> &out, bool split);
+
+    uint32_t pageCount;
+    std::vector<Entry> entries;
+    std::unordered_map<std::string, std::vector<uint32_t>> postings;
+};
+#endif
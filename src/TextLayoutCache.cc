@@ -0,0 +1,79 @@
+#include "TextLayoutCache.h"
+
+TextLayoutCache::~TextLayoutCache()
+{
+    for (Entry &entry : entries)
+    {
+        entry.text->decRefCnt();
+    }
+}
+
+TextPage *TextLayoutCache::get(int page, bool rawOrder)
+{
+    std::lock_guard<std::mutex> guard(lock);
+    auto it = index.find(Key(page, rawOrder));
+    if (it == index.end())
+    {
+        return NULL;
+    }
+    entries.splice(entries.begin(), entries, it->second);
+    TextPage *text = it->second->text;
+    text->incRefCnt();
+    return text;
+}
+
+void TextLayoutCache::put(int page, bool rawOrder, TextPage *text)
+{
+    size_t bytes = estimateSize(text);
+    if (bytes > budget)
+    {
+        return;
+    }
+
+    std::lock_guard<std::mutex> guard(lock);
+    Key key(page, rawOrder);
+    auto it = index.find(key);
+    if (it != index.end())
+    {
+        // laid out concurrently, keep the newer one
+        used -= it->second->bytes;
+        it->second->text->decRefCnt();
+        entries.erase(it->second);
+        index.erase(it);
+    }
+    text->incRefCnt();
+    entries.push_front(Entry{key, text, bytes});
+    index[key] = entries.begin();
+    used += bytes;
+    evict();
+}
+
+void TextLayoutCache::evict()
+{
+    while (used > budget && !entries.empty())
+    {
+        Entry &last = entries.back();
+        used -= last.bytes;
+        last.text->decRefCnt();
+        index.erase(last.key);
+        entries.pop_back();
+    }
+}
+
+size_t TextLayoutCache::estimateSize(TextPage *text)
+{
+    // TextWord keeps per character code, Unicode, edge, font and char pos
+    // arrays, plus its own fields and the pools/lines/blocks pointing at it
+    const size_t perWord = 256;
+    const size_t perChar = 48;
+    size_t bytes = 4096;
+    auto wordList = text->makeWordList(true);
+    for (int i = 0; i < wordList->getLength(); i++)
+    {
+        bytes += perWord + perChar * wordList->get(i)->getLength();
+    }
+#if (POPPLER_VERSION_MAJOR == 21 && POPPLER_VERSION_MINOR < 11) || POPPLER_VERSION_MAJOR < 21
+    delete wordList;
+#endif
+    return bytes;
+}
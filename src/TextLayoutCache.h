@@ -0,0 +1,57 @@
+#ifndef __TEXT_LAYOUT_CACHE
+#define __TEXT_LAYOUT_CACHE
+#include <list>
+#include <map>
+#include <mutex>
+#include <utility>
+#include <cpp/poppler-version.h>
+#include <poppler/TextOutputDev.h>
+
+/**
+ * Per-document LRU cache of page text layouts, keyed by page number and
+ * reading order, holding at most `budget` bytes (estimated) of TextPages.
+ *
+ * Shared by all NodePopplerPage objects of a document, so laying out a page
+ * once serves getWordList/findText of any object for that page.
+ */
+class TextLayoutCache
+{
+public:
+    explicit TextLayoutCache(size_t budget) : used(0), budget(budget) {}
+    ~TextLayoutCache();
+
+    /**
+     * \return cached layout with a reference added for the caller, or NULL
+     */
+    TextPage *get(int page, bool rawOrder);
+
+    /**
+     * Adds a reference to `text` and caches it, evicting least recently used
+     * layouts over the budget. A layout larger than the budget is not kept.
+     */
+    void put(int page, bool rawOrder, TextPage *text);
+
+    /**
+     * Rough heap size of a layout, from its word and character counts.
+     */
+    static size_t estimateSize(TextPage *text);
+
+private:
+    typedef std::pair<int, bool> Key;
+    struct Entry
+    {
+        Key key;
+        TextPage *text;
+        size_t bytes;
+    };
+
+    void evict();
+
+    std::mutex lock;
+    // most recently used first
+    std::list<Entry> entries;
+    std::map<Key, std::list<Entry>::iterator> index;
+    size_t used;
+    size_t budget;
+};
+#endif
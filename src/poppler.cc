@@ -2,10 +2,77 @@
 #include <node.h>
 #include "NodePopplerDocument.h"
 #include "NodePopplerPage.h"
+#include "NodeTextIndex.h"
+#include "RenderCache.h"
+#include "RenderPool.h"
 
 using namespace v8;
 using namespace node;
 
+/**
+ * Sets the number of threads rendering pages
+ *
+ * \param concurrency Number positive integer
+ */
+NAN_METHOD(setConcurrency) {
+    if (info.Length() < 1 || !info[0]->IsUint32() || Nan::To<uint32_t>(info[0]).FromJust() == 0) {
+        return Nan::ThrowError("Arguments: (concurrency: Number) - a positive integer");
+    }
+    RenderPool::setConcurrency(Nan::To<uint32_t>(info[0]).FromJust());
+}
+
+NAN_METHOD(getConcurrency) {
+    info.GetReturnValue().Set(Nan::New<Uint32>((uint32_t)RenderPool::getConcurrency()));
+}
+
+/**
+ * Configures the cache of encoded renders
+ *
+ * \param options Object with optional fields:
+ *   maxBytes: Number - memory budget in bytes, 0 keeps nothing in memory (default 0)
+ *   spillDir: String - directory for images dropped from memory, null for none
+ */
+NAN_METHOD(setRenderCache) {
+    if (info.Length() < 1 || !info[0]->IsObject()) {
+        return Nan::ThrowError("Arguments: (options: {maxBytes?: Number, spillDir?: String})");
+    }
+    Local<v8::Object> options = Nan::To<v8::Object>(info[0]).ToLocalChecked();
+    Local<String> mk = Nan::New("maxBytes").ToLocalChecked();
+    Local<String> dk = Nan::New("spillDir").ToLocalChecked();
+    size_t maxBytes = 0;
+    std::string spillDir;
+    if (Nan::Has(options, mk).FromMaybe(false)) {
+        Local<Value> mv = Nan::Get(options, mk).ToLocalChecked();
+        if (!mv->IsNumber() || Nan::To<double>(mv).FromJust() < 0) {
+            return Nan::ThrowError("'maxBytes' option value must be a non-negative number");
+        }
+        maxBytes = (size_t)Nan::To<double>(mv).FromJust();
+    }
+    if (Nan::Has(options, dk).FromMaybe(false)) {
+        Local<Value> dv = Nan::Get(options, dk).ToLocalChecked();
+        if (dv->IsString() && Nan::Utf8String(dv).length() > 0) {
+            spillDir = *Nan::Utf8String(dv);
+        } else if (!dv->IsNull() && !dv->IsUndefined()) {
+            return Nan::ThrowError("'spillDir' option value must be a non-empty string or null");
+        }
+    }
+    RenderCache::configure(maxBytes, spillDir);
+}
+
+NAN_METHOD(clearRenderCache) {
+    RenderCache::clear();
+}
+
+NAN_METHOD(getRenderCacheStats) {
+    RenderCache::Stats s = RenderCache::stats();
+    Local<v8::Object> out = Nan::New<v8::Object>();
+    Nan::Set(out, Nan::New("bytes").ToLocalChecked(), Nan::New<Number>((double)s.bytes));
+    Nan::Set(out, Nan::New("entries").ToLocalChecked(), Nan::New<Number>((double)s.entries));
+    Nan::Set(out, Nan::New("hits").ToLocalChecked(), Nan::New<Number>((double)s.hits));
+    Nan::Set(out, Nan::New("misses").ToLocalChecked(), Nan::New<Number>((double)s.misses));
+    info.GetReturnValue().Set(out);
+}
+
 NAN_MODULE_INIT(InitAll) {
 #if POPPLER_VERSION_MAJOR == 0 && POPPLER_VERSION_MINOR < 83
     globalParams = new GlobalParams();
@@ -14,6 +81,12 @@ NAN_MODULE_INIT(InitAll) {
 #endif
     NodePopplerPage::Init(target);
     NodePopplerDocument::Init(target);
+    NodeTextIndex::Init(target);
+    Nan::SetMethod(target, "setConcurrency", setConcurrency);
+    Nan::SetMethod(target, "getConcurrency", getConcurrency);
+    Nan::SetMethod(target, "setRenderCache", setRenderCache);
+    Nan::SetMethod(target, "clearRenderCache", clearRenderCache);
+    Nan::SetMethod(target, "getRenderCacheStats", getRenderCacheStats);
 }
 
 NODE_MODULE(poppler, InitAll)
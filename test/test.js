@@ -1,4 +1,4 @@
-/*global it:true, describe:true, require:true, __dirname:true, gc:true, before:true */
+/*global it:true, describe:true, require:true, __dirname:true, gc:true, before:true, AbortController:true */
 /*jshint node:true */
 'use strict';
 
@@ -57,6 +57,44 @@ function getExpectedFileName(iteration, format) {
     return PATHS[format][iteration];
 }
 
+/**
+ * Decodes a non-interlaced 1 or 8 bit gray PNG into unfiltered rows.
+ */
+function decodeGrayPng(png) {
+    var width = png.readUInt32BE(16);
+    var height = png.readUInt32BE(20);
+    var bits = png[24];
+    var idat = [];
+    for (var pos = 8; pos < png.length; ) {
+        var len = png.readUInt32BE(pos);
+        if (png.toString('ascii', pos + 4, pos + 8) === 'IDAT') {
+            idat.push(png.slice(pos + 8, pos + 8 + len));
+        }
+        pos += len + 12;
+    }
+    var raw = require('zlib').inflateSync(Buffer.concat(idat));
+    var stride = Math.ceil(width * bits / 8);
+    var rows = [];
+    var prev = Buffer.alloc(stride);
+    for (var y = 0; y < height; y++) {
+        var filter = raw[y * (stride + 1)];
+        var row = Buffer.from(raw.slice(y * (stride + 1) + 1, (y + 1) * (stride + 1)));
+        for (var i = 0; i < stride; i++) {
+            var left = i > 0 ? row[i - 1] : 0;
+            var up = prev[i];
+            var upLeft = i > 0 ? prev[i - 1] : 0;
+            var p = left + up - upLeft;
+            var pa = Math.abs(p - left), pb = Math.abs(p - up), pc = Math.abs(p - upLeft);
+            var pred = [0, left, up, (left + up) >> 1,
+                pa <= pb && pa <= pc ? left : (pb <= pc ? up : upLeft)][filter];
+            row[i] = (row[i] + pred) & 0xff;
+        }
+        rows.push(row);
+        prev = row;
+    }
+    return { width: width, height: height, bits: bits, rows: rows };
+}
+
 function getOutFileName(iteration, format) {
     var rand = Math.ceil(Math.random() * 100000000000);
     return 'test/out' + rand + '.' + format;
@@ -143,6 +181,134 @@ describe('poppler module', function () {
     it('should be loaded', function () {
         a.ok(poppler && poppler.PopplerDocument && poppler.PopplerPage);
     });
+    it('should change render concurrency', function () {
+        this.timeout(0);
+        var concurrency = poppler.getConcurrency();
+        a.ok(concurrency > 0);
+        a.throws(function () {
+            poppler.setConcurrency(0);
+        }, new RegExp('positive integer'));
+        poppler.setConcurrency(2);
+        a.equal(poppler.getConcurrency(), 2);
+        var renders = [];
+        for (var i = 0; i < 8; i++) {
+            var doc = new poppler.PopplerDocument(targets[i % targets.length]);
+            renders.push(doc.getPage(1).renderToBufferAsync('png', 72));
+        }
+        return Promise.all(renders).then(function (results) {
+            results.forEach(function (out) {
+                a.ok(out.data.length > 0);
+            });
+            poppler.setConcurrency(concurrency);
+        });
+    });
+    it('should run high priority renders first', function () {
+        this.timeout(0);
+        var concurrency = poppler.getConcurrency();
+        var page = new poppler.PopplerDocument(targets[0]).getPage(1);
+        var order = [];
+        var render = function (name, priority) {
+            return page.renderToBufferAsync('png', 150, { priority: priority })
+                .then(function () {
+                    order.push(name);
+                });
+        };
+        a.throws(function () {
+            page.renderToBuffer('png', 72, { priority: 'urgent' });
+        }, new RegExp('\'priority\' option value must be'));
+        poppler.setConcurrency(1);
+        var renders = [];
+        for (var i = 0; i < 4; i++) {
+            renders.push(render('low' + i, 'low'));
+        }
+        renders.push(render('high', 'high'));
+        return Promise.all(renders).then(function () {
+            a.ok(order.indexOf('high') < order.indexOf('low3'));
+            poppler.setConcurrency(concurrency);
+        });
+    });
+    it('should keep aged low priority renders behind high ones', function () {
+        this.timeout(0);
+        var concurrency = poppler.getConcurrency();
+        var page = new poppler.PopplerDocument(targets[0]).getPage(1);
+        var Writable = require('stream').Writable;
+        var order = [];
+        // holds the only render thread until nothing was written for 700 ms
+        var block = function (name, priority) {
+            var stuck = new Writable({ write: function () {} });
+            return page.renderToWritable(stuck, 'tiff', 150, { compression: 'none', stallTimeoutMs: 700, priority: priority })
+                .catch(function (err) {
+                    a.equal(err.code, 'ERR_RENDER_STALLED');
+                    order.push(name);
+                });
+        };
+        var render = function (name, priority) {
+            return page.renderToBufferAsync('png', 72, { priority: priority })
+                .then(function () {
+                    order.push(name);
+                });
+        };
+        poppler.setConcurrency(1);
+        var renders = [block('blocker', 'normal')];
+        var high = null;
+        // the low renders wait through more than two aging intervals
+        renders.push(block('low0', 'low').then(function () {
+            return new Promise(function (resolve) {
+                setTimeout(resolve, 100);
+            }).then(function () {
+                high = render('high', 'high');
+                return high;
+            });
+        }));
+        renders.push(block('low1', 'low'));
+        renders.push(render('low2', 'low'));
+        renders.push(render('low3', 'low'));
+        return Promise.all(renders).then(function () {
+            poppler.setConcurrency(concurrency);
+            // low2 and low3 age up to normal while queued, still behind high;
+            // the exact order of the rest depends on timing
+            a.equal(order.length, 6);
+            a.ok(order.indexOf('high') < order.indexOf('low2'), order.join());
+            a.ok(order.indexOf('high') < order.indexOf('low3'), order.join());
+        }, function (err) {
+            poppler.setConcurrency(concurrency);
+            throw err;
+        });
+    });
+    it('should serve repeated renders from the render cache', function () {
+        this.timeout(0);
+        var spillDir = fs.mkdtempSync(require('os').tmpdir() + '/psmpl-cache-');
+        a.throws(function () {
+            poppler.setRenderCache({ maxBytes: -1 });
+        }, new RegExp('\'maxBytes\' option value must be'));
+        poppler.setRenderCache({ maxBytes: 64 << 20 });
+        var page = new poppler.PopplerDocument(targets[0]).getPage(1);
+        var first = page.renderToBuffer('png', 72);
+        var stats = poppler.getRenderCacheStats();
+        a.equal(stats.entries, 1);
+        // same data opened again shares the entry
+        var again = new poppler.PopplerDocument(fs.readFileSync(names[0])).getPage(1).renderToBuffer('png', 72);
+        a.deepEqual(again.data, first.data);
+        a.equal(poppler.getRenderCacheStats().hits, stats.hits + 1);
+        page.renderToBuffer('png', 72, { cache: false });
+        page.renderToBuffer('png', 96);
+        a.equal(poppler.getRenderCacheStats().entries, 2);
+        // data that may change under the document is never cached
+        var source = fs.readFileSync(names[0]);
+        new poppler.PopplerDocument(source, null, null, { copyBuffer: false }).getPage(1).renderToBuffer('png', 110);
+        new poppler.PopplerDocument(names[0], null, null, { mmap: true }).getPage(1).renderToBuffer('png', 110);
+        a.equal(poppler.getRenderCacheStats().entries, 2);
+        // nothing fits in memory, everything goes through the spill directory
+        poppler.setRenderCache({ maxBytes: 0, spillDir: spillDir });
+        a.equal(poppler.getRenderCacheStats().entries, 0);
+        a.equal(fs.readdirSync(spillDir).length, 2);
+        a.deepEqual(page.renderToBuffer('png', 72).data, first.data);
+        poppler.setRenderCache({});
+        fs.readdirSync(spillDir).forEach(function (name) {
+            fs.unlinkSync(spillDir + '/' + name);
+        });
+        fs.rmdirSync(spillDir);
+    });
 });
 
 describe('PopplerDocument', function () {
@@ -182,6 +348,158 @@ describe('PopplerDocument', function () {
             a.equal(d.fileName, null);
         }
     });
+    it('should open pdf file asynchronously', function () {
+        this.timeout(0);
+        return Promise.all(targets.map(function (x) {
+            return poppler.PopplerDocument.open(x);
+        })).then(function (opened) {
+            for (var i = opened.length - 1; i >= 0; i--) {
+                var d = opened[i];
+                a.ok(d instanceof poppler.PopplerDocument);
+                a.equal(d.pdfVersion, 'PDF-1.4');
+                a.equal(d.pageCount, 1);
+                a.equal(d.fileName, names[i]);
+            }
+        });
+    });
+    it('should open pdf file from buffer asynchronously', function () {
+        this.timeout(0);
+        return poppler.PopplerDocument.open(fs.readFileSync(names[0]))
+            .then(function (d) {
+                a.equal(d.pageCount, 1);
+                a.equal(d.fileName, null);
+                a.equal(d.getPage(1).getWordList().length, 45);
+            });
+    });
+    it('should reject on non existing document', function () {
+        this.timeout(0);
+        return poppler.PopplerDocument.open('file:///123.pdf').then(function () {
+            a.fail('should not resolve');
+        }, function (err) {
+            a.ok(/Couldn't open file - fopen error. Errno: 2./.test(err.message));
+        });
+    });
+    it('should open pdf file through a read function', function () {
+        this.timeout(0);
+        var data = fs.readFileSync(names[0]);
+        var reads = 0;
+        var source = {
+            size: data.length,
+            read: function (offset, length) {
+                reads++;
+                return Promise.delay(1).then(function () {
+                    return data.slice(offset, offset + length);
+                });
+            }
+        };
+        a.throws(function () {
+            new poppler.PopplerDocument(source);
+        }, /must be opened with PopplerDocument.open/);
+        return poppler.PopplerDocument.open(source).then(function (d) {
+            a.ok(reads > 0);
+            a.equal(d.pageCount, 1);
+            a.equal(d.fileName, null);
+            return Promise.all([d.getPageAsync(1), d.getPageAsync(2)]);
+        }).then(function (pages) {
+            a.equal(pages[1], null);
+            a.throws(function () {
+                pages[0].getWordList();
+            }, /support only asynchronous calls/);
+            a.throws(function () {
+                pages[0].renderToBuffer('png', 50);
+            }, /support only asynchronous calls/);
+            var expected = new poppler.PopplerDocument(data).getPage(1).renderToBuffer('png', 50).data;
+            return pages[0].renderToBufferAsync('png', 50).then(function (result) {
+                a.ok(result.data.equals(expected));
+            });
+        });
+    });
+    it('should read only the first page of a linearized document', function () {
+        this.timeout(0);
+        var data = fs.readFileSync(__dirname + '/fixtures/linearized.pdf');
+        // the middle of the last page's content stream
+        var last = data.indexOf('% page 8 content') + 20000;
+        var ranges = [];
+        var source = {
+            size: data.length,
+            read: function (offset, length) {
+                ranges.push([offset, offset + length]);
+                return Promise.resolve(data.slice(offset, offset + length));
+            }
+        };
+        return poppler.PopplerDocument.open(source).then(function (d) {
+            a.equal(d.isLinearized, true);
+            a.equal(d.pageCount, 8);
+            return d.getPageAsync(1);
+        }).then(function (p) {
+            return p.renderToBufferAsync('png', 72);
+        }).then(function (result) {
+            a.ok(result.data.length > 0);
+            var fetched = ranges.reduce(function (sum, r) {
+                return sum + r[1] - r[0];
+            }, 0);
+            a.ok(fetched < data.length / 2, fetched + ' of ' + data.length + ' bytes fetched');
+            ranges.forEach(function (r) {
+                a.ok(r[1] <= last || r[0] > last, 'fetched ' + r + ' of the last page');
+            });
+        });
+    });
+    it('should reject when a read never completes', function () {
+        this.timeout(0);
+        return poppler.PopplerDocument.open({
+            size: 100000,
+            read: function () {
+                return new Promise(function () {});
+            }
+        }, null, null, { readTimeoutMs: 100 }).then(function () {
+            a.fail('should not resolve');
+        }, function (err) {
+            a.ok(/Couldn't open file/.test(err.message));
+        });
+    });
+    it('should reject when a read fails', function () {
+        this.timeout(0);
+        return poppler.PopplerDocument.open({
+            size: 100000,
+            read: function () {
+                throw new Error('unreachable');
+            }
+        }).then(function () {
+            a.fail('should not resolve');
+        }, function (err) {
+            a.ok(/Couldn't open file/.test(err.message));
+        });
+    });
+    it('should open pdf file from buffer without copying', function () {
+        this.timeout(0);
+        var buffer = fs.readFileSync(names[0]);
+        var d = new poppler.PopplerDocument(buffer, null, null, { copyBuffer: false });
+        a.equal(d.pageCount, 1);
+        a.equal(d.getPage(1).getWordList().length, 45);
+        var ab = buffer.buffer.slice(buffer.byteOffset, buffer.byteOffset + buffer.length);
+        a.throws(function () {
+            new poppler.PopplerDocument(ab, null, null, { copyBuffer: false });
+        }, /'copyBuffer' can be false only for a Buffer/);
+        d = new poppler.PopplerDocument(ab);
+        a.equal(d.pageCount, 1);
+        a.ok(d.getPage(1).renderToBuffer('png', 50).data.length > 0);
+    });
+    it('should open memory-mapped pdf file', function () {
+        this.timeout(0);
+        var mapped = targets.map(function (x) {
+            return new poppler.PopplerDocument(x, null, null, { mmap: true });
+        });
+        for (var i = mapped.length - 1; i >= 0; i--) {
+            var d = mapped[i];
+            a.equal(d.pdfVersion, 'PDF-1.4');
+            a.equal(d.pageCount, 1);
+            a.equal(d.fileName, names[i]);
+            a.equal(d.getPage(1).getWordList().length, 45);
+        }
+        a.throws(function () {
+            new poppler.PopplerDocument('file:///123.pdf', null, null, { mmap: true });
+        }, new RegExp('Couldn\'t open file - fopen error. Errno: 2.'));
+    });
     it('should open an encrypted pdf file', function () {
         this.timeout(0);
         var fileName = __dirname + '/fixtures/encrypted.pdf';
@@ -203,6 +521,77 @@ describe('PopplerDocument', function () {
         a.equal(d.PDFMinorVersion, 6);
         a.equal(d.fileName, fileName);
     });
+    it('should open a password protected pdf file from buffer', function () {
+        this.timeout(0);
+        var buffer = fs.readFileSync(__dirname + '/fixtures/password_protected.pdf');
+        var d = new poppler.PopplerDocument(buffer, '1234');
+        a.equal(d.isEncrypted, true);
+        a.equal(d.pageCount, 1);
+        a.equal(d.fileName, null);
+    });
+    it('should render many pages with one call', function () {
+        this.timeout(0);
+        var d = new poppler.PopplerDocument(targets[0]);
+        return d.renderPages({ pages: [1, 1, 1], method: 'png', PPI: 50 })
+            .then(function (results) {
+                a.equal(results.length, 3);
+                results.forEach(function (x) {
+                    a.ok(Buffer.isBuffer(x));
+                    a.ok(x.length > 0);
+                    a.ok(x.equals(results[0]));
+                });
+                return d.renderPages({ method: 'jpeg', PPI: 50, options: { quality: 75 } });
+            })
+            .then(function (results) {
+                a.equal(results.length, 1);
+                return d.renderPages({ pages: [2], method: 'jpeg', PPI: 50 });
+            })
+            .then(function () {
+                a.fail('should not resolve');
+            }, function (err) {
+                a.equal(err.message, 'Page number out of bounds.');
+                return d.renderPages({ method: 'raw', PPI: 50 });
+            })
+            .then(function () {
+                a.fail('raw batch should not resolve');
+            }, function (err) {
+                a.ok(/'raw' method is not supported/.test(err.message));
+                if (typeof AbortController === 'undefined') {
+                    return;
+                }
+                var controller = new AbortController();
+                controller.abort();
+                return d.renderPages({ pages: [1, 1], method: 'png', PPI: 50, options: { signal: controller.signal } })
+                    .then(function () {
+                        a.fail('aborted batch should not resolve');
+                    }, function (err) {
+                        a.equal(err.code, 'ERR_RENDER_ABORTED');
+                    });
+            });
+    });
+    it('should build and search a text index', function () {
+        this.timeout(0);
+        var doc = new poppler.PopplerDocument(targets[0]);
+        return doc.buildTextIndex().then(function (index) {
+            a.strictEqual(doc.textIndex, index);
+            a.equal(index.pageCount, 1);
+            a.equal(index.wordCount, doc.getPage(1).getWordList().length);
+            var first = doc.getPage(1).getWordList()[0];
+            var hits = doc.search('российская');
+            a.ok(hits.length > 0);
+            a.equal(hits[0].page, 1);
+            a.ok(Math.abs(hits[0].x1 - first.x1) < 1e-6);
+            a.ok(Math.abs(hits[0].y2 - first.y2) < 1e-6);
+            a.deepEqual(doc.search('no-such-word-here'), []);
+
+            var copy = new poppler.PopplerDocument(targets[0]);
+            copy.loadTextIndex(index.serialize());
+            a.deepEqual(copy.search('российская'), hits);
+            a.throws(function () {
+                copy.loadTextIndex(Buffer.from('garbage'));
+            }, new RegExp('Invalid text index data'));
+        });
+    });
     it('should throw on non existing page', function () {
         this.timeout(0);
         let page = docs[0].getPage(65536);
@@ -295,6 +684,251 @@ describe('PopplerPage', function () {
             text: 'вв.)'
         });
     });
+    it('should return columnar word list', function () {
+        this.timeout(0);
+        pages.forEach(function (x) {
+            var words = x.getWordList();
+            var columns = x.getWordList({ format: 'columnar' });
+            a.ok(columns.bboxes instanceof Float64Array);
+            a.ok(columns.offsets instanceof Uint32Array);
+            a.equal(columns.bboxes.length, words.length * 4);
+            a.equal(columns.offsets.length, words.length + 1);
+            words.forEach(function (word, i) {
+                a.deepEqual({
+                    x1: columns.bboxes[i * 4],
+                    y1: columns.bboxes[i * 4 + 1],
+                    x2: columns.bboxes[i * 4 + 2],
+                    y2: columns.bboxes[i * 4 + 3],
+                    text: columns.text.toString('utf8', columns.offsets[i], columns.offsets[i + 1])
+                }, word);
+            });
+        });
+        a.throws(function () {
+            pages[0].getWordList({ format: 'rows' });
+        }, new RegExp('\'format\' option value must be'));
+    });
+    it('should render tiles', function () {
+        this.timeout(0);
+        var page = pages[0];
+        var width = Math.floor(page.width * 2);
+        var height = Math.floor(page.height * 2);
+        var tiles = [];
+        for (var y = 0; y * 256 < height; y++) {
+            for (var x = 0; x * 256 < width; x++) {
+                tiles.push({ x: x, y: y });
+            }
+        }
+        var rendered = [];
+        return page.renderTiles('png', 144, { tiles: tiles }, function (tile) {
+            a.equal(tile.format, 'png');
+            a.ok(tile.data.length > 0);
+            rendered.push(tile);
+        }).then(function () {
+            a.equal(rendered.length, tiles.length);
+            var rowWidth = rendered.filter(function (t) {
+                return t.y === 0;
+            }).reduce(function (sum, t) {
+                return sum + t.width;
+            }, 0);
+            a.equal(rowWidth, width);
+            return page.renderTiles('jpeg', 144, { tiles: [{ x: 100, y: 0 }] }, function () {});
+        }).then(function () {
+            a.fail('tile outside of the page was rendered');
+        }, function (err) {
+            a.ok(/outside of the page/.test(err.message));
+            return page.renderTiles('png', 144, { tiles: [] }, function () {});
+        }).then(function () {
+            a.fail('empty tile list was accepted');
+        }, function (err) {
+            a.ok(/'tiles' option value must be/.test(err.message));
+        });
+    });
+    it('should render distant tiles one by one', function () {
+        this.timeout(0);
+        var page = pages[0];
+        var options = { colorMode: 'mono', tileSize: 64 };
+        // opposite corners at 1200 PPI span more than 100M pixels
+        var corners = [{ x: 0, y: 0 }, { x: 150, y: 200 }];
+        var render = function (tiles) {
+            var out = {};
+            return page.renderTiles('png', 1200, Object.assign({ tiles: tiles }, options), function (tile) {
+                out[tile.x + ',' + tile.y] = decodeGrayPng(tile.data).rows;
+            }).then(function () {
+                return out;
+            });
+        };
+        return Promise.all([render(corners), render([corners[0]]), render([corners[1]])]).then(function (results) {
+            a.deepEqual(Object.keys(results[0]).sort(), ['0,0', '150,200']);
+            a.deepEqual(results[0]['0,0'], results[1]['0,0']);
+            a.deepEqual(results[0]['150,200'], results[2]['150,200']);
+        });
+    });
+    it('should render a preview before the final image', function () {
+        this.timeout(0);
+        var page = pages[0];
+        var preview = null;
+        return page.renderProgressive('png', 150, {}, function (result) {
+            preview = result;
+        }).then(function (result) {
+            a.ok(preview !== null);
+            a.equal(preview.PPI, 36);
+            a.equal(preview.format, 'png');
+            a.equal(preview.width, Math.floor(page.width / 2));
+            a.ok(result.data.length > preview.data.length);
+            a.deepEqual(result.data, page.renderToBuffer('png', 150).data);
+            return page.renderProgressive('jpeg', 150, { previewPPI: 0 }, function () {});
+        }).then(function () {
+            a.fail('zero preview resolution was accepted');
+        }, function (err) {
+            a.ok(/'previewPPI' option value must be/.test(err.message));
+        });
+    });
+    it('should call onPreview for repeated progressive renders', function () {
+        this.timeout(0);
+        var page = pages[0];
+        var previews = 0;
+        var onPreview = function () {
+            previews++;
+        };
+        poppler.setRenderCache({ maxBytes: 64 << 20 });
+        return page.renderProgressive('png', 120, {}, onPreview).then(function () {
+            return page.renderProgressive('png', 120, {}, onPreview);
+        }).then(function () {
+            poppler.setRenderCache({});
+            a.equal(previews, 2);
+        }, function (err) {
+            poppler.setRenderCache({});
+            throw err;
+        });
+    });
+    it('should render in bands to a writable stream', function () {
+        this.timeout(0);
+        var page = pages[0];
+        var PassThrough = require('stream').PassThrough;
+        var out = new PassThrough();
+        var chunks = [];
+        out.on('data', function (chunk) {
+            chunks.push(chunk);
+        });
+        return page.renderToWritable(out, 'png', 300, { bandHeight: 64 }).then(function () {
+            var png = Buffer.concat(chunks);
+            a.equal(png.toString('ascii', 1, 4), 'PNG');
+            // IHDR holds the full page size
+            a.equal(png.readUInt32BE(16), Math.floor(page.width * 300 / 72));
+            a.equal(png.readUInt32BE(20), Math.floor(page.height * 300 / 72));
+            return page.renderToWritable(new PassThrough(), 'jpeg', 72, { bandHeight: 0 });
+        }).then(function () {
+            a.fail('zero band height was accepted');
+        }, function (err) {
+            a.ok(/'bandHeight' option value must be/.test(err.message));
+        });
+    });
+    it('should stop waiting for a writable that never drains', function () {
+        this.timeout(0);
+        var page = pages[0];
+        var Writable = require('stream').Writable;
+        // takes chunks without ever calling back
+        var stuck = function () {
+            return new Writable({ write: function () {} });
+        };
+        var opts = { compression: 'none', bandHeight: 64 };
+        return page.renderToWritable(stuck(), 'tiff', 300, Object.assign({ stallTimeoutMs: 100 }, opts)).then(function () {
+            a.fail('stalled render resolved');
+        }, function (err) {
+            a.equal(err.code, 'ERR_RENDER_STALLED');
+            return page.renderToWritable(stuck(), 'tiff', 300, Object.assign({ stallTimeoutMs: 0, deadlineMs: 300 }, opts));
+        }).then(function () {
+            a.fail('render past its deadline resolved');
+        }, function (err) {
+            a.equal(err.code, 'ERR_RENDER_TIMEOUT');
+        });
+    });
+    it('should render into a readable stream', function () {
+        this.timeout(0);
+        var page = pages[0];
+        var read = function (stream) {
+            return new Promise(function (resolve, reject) {
+                var chunks = [];
+                stream.on('data', function (chunk) {
+                    chunks.push(chunk);
+                });
+                stream.on('end', function () {
+                    resolve(Buffer.concat(chunks));
+                });
+                stream.on('error', reject);
+            });
+        };
+        return read(page.renderToStream('jpeg', 150)).then(function (jpeg) {
+            a.equal(jpeg.readUInt16BE(0), 0xffd8);
+            a.equal(jpeg.readUInt16BE(jpeg.length - 2), 0xffd9);
+            return read(page.renderToStream('gif', 150));
+        }).then(function () {
+            a.fail('unsupported format was accepted');
+        }, function (err) {
+            a.ok(/Unsupported compression method/.test(err.message));
+        });
+    });
+    it('should fail a readable stream left paused', function () {
+        this.timeout(0);
+        var stream = pages[0].renderToStream('tiff', 300, { compression: 'none', stallTimeoutMs: 100 });
+        return new Promise(function (resolve, reject) {
+            stream.on('error', resolve);
+            stream.on('end', function () {
+                reject(new Error('paused stream ended'));
+            });
+            // starts rendering, nothing is read after that
+            stream.read(0);
+        }).then(function (err) {
+            a.equal(err.code, 'ERR_RENDER_STALLED');
+        });
+    });
+    it('should cache text layout for both reading orders', function () {
+        this.timeout(0);
+        var d = new poppler.PopplerDocument(names[0], null, null, { textCacheSize: 1 << 20 });
+        var reading = d.getPage(1).getWordList();
+        var raw = d.getPage(1).getWordList(true);
+        a.equal(raw.length, reading.length);
+        a.deepEqual(d.getPage(1).getWordList(true), raw);
+        a.deepEqual(d.getPage(1).getWordList(false), reading);
+        // a cache too small for any layout still yields words
+        d = new poppler.PopplerDocument(names[0], null, null, { textCacheSize: 0 });
+        a.deepEqual(d.getPage(1).getWordList(), reading);
+        a.throws(function () {
+            new poppler.PopplerDocument(names[0], null, null, { textCacheSize: -1 });
+        }, new RegExp('\'textCacheSize\' option value must be'));
+    });
+    it('should search for many texts at once', function () {
+        this.timeout(0);
+        var terms = ['ко', 'Российская', 'no-such-text'];
+        pages.forEach(function (x) {
+            var results = x.findText(terms);
+            a.equal(results.length, terms.length);
+            terms.forEach(function (term, i) {
+                var expected = x.findText(term);
+                a.equal(results[i].length, expected.length);
+                results[i].forEach(function (rect, k) {
+                    ['x1', 'x2', 'y1', 'y2'].forEach(function (key) {
+                        a.ok(Math.abs(rect[key] - expected[k][key]) < 0.01);
+                    });
+                });
+            });
+        });
+        a.throws(function () {
+            pages[0].findText(['ко', 1]);
+        }, new RegExp('Search terms must be strings'));
+    });
+    it('should return word list and search for text asynchronously', function () {
+        this.timeout(0);
+        return Promise.all(targets.map(function (x) {
+            var page = new poppler.PopplerDocument(x).getPage(1);
+            return page.loadText().then(function () {
+                return Promise.all([page.getWordListAsync(), page.findTextAsync('ко')]);
+            }).then(function (results) {
+                a.deepEqual(results[0], page.getWordList());
+                a.deepEqual(results[1], page.findText('ко'));
+            });
+        }));
+    });
     it('should search for text', function () {
         this.timeout(0);
         var results = pages.map(function (x) {
@@ -502,6 +1136,127 @@ describe('PopplerPage', function () {
             return renderToBuffer(pages, 'tiff');
         });
     });
+    describe('render to raw pixels', function () {
+        it('should render rgb, rgba and gray pixels', function () {
+            this.timeout(0);
+            var bpp = { rgb: 3, rgba: 4, gray: 1 };
+            Object.keys(bpp).forEach(function (colorMode) {
+                var out = pages[0].renderToBuffer('raw', 72, { colorMode: colorMode });
+                a.equal(out.type, 'buffer');
+                a.equal(out.format, 'raw');
+                a.equal(out.colorMode, colorMode);
+                a.equal(out.width, 299);
+                a.equal(out.height, 572);
+                a.ok(out.stride >= out.width * bpp[colorMode]);
+                a.equal(out.data.length, out.stride * out.height);
+            });
+        });
+        it('should render raw pixels asynchronously', function () {
+            this.timeout(0);
+            return pages[1].renderToBufferAsync('raw', 72, { colorMode: 'gray' })
+                .then(function (out) {
+                    a.equal(out.width, 572);
+                    a.equal(out.height, 299);
+                    a.equal(out.data.length, out.stride * out.height);
+                });
+        });
+        it('should throw on bad color mode', function () {
+            this.timeout(0);
+            a.throws(function () {
+                pages[0].renderToBuffer('raw', 72, { colorMode: 'cmyk' });
+            }, new RegExp('\'colorMode\' option value must be'));
+        });
+        it('should not render raw pixels to file', function () {
+            this.timeout(0);
+            a.throws(function () {
+                pages[0].renderToFile('test/x.raw', 'raw', 72);
+            }, new RegExp('Unsupported compression method'));
+        });
+    });
+    describe('render color modes and backgrounds', function () {
+        it('should render gray and bilevel png', function () {
+            this.timeout(0);
+            var gray = pages[0].renderToBuffer('png', 72, { colorMode: 'gray' }).data;
+            var mono = pages[0].renderToBuffer('png', 72, { colorMode: 'mono' }).data;
+            // IHDR bit depth and color type
+            a.equal(gray[24], 8);
+            a.equal(gray[25], 0);
+            a.equal(mono[24], 1);
+            a.equal(mono[25], 0);
+        });
+        it('should encode mono pages, bands and tiles alike', function () {
+            this.timeout(0);
+            var page = pages[0];
+            var whole = decodeGrayPng(page.renderToBuffer('png', 72, { colorMode: 'mono' }).data);
+            a.equal(whole.bits, 1);
+            // paper is white, PNG takes set bits as white
+            a.equal(whole.rows[0][0] & 0x80, 0x80);
+            var PassThrough = require('stream').PassThrough;
+            var out = new PassThrough();
+            var chunks = [];
+            out.on('data', function (chunk) {
+                chunks.push(chunk);
+            });
+            return page.renderToWritable(out, 'png', 72, { colorMode: 'mono', bandHeight: 16 }).then(function () {
+                var bands = decodeGrayPng(Buffer.concat(chunks));
+                a.equal(bands.height, whole.height);
+                a.deepEqual(bands.rows, whole.rows);
+                var tiles = [];
+                return page.renderTiles('png', 72, { colorMode: 'mono', tileSize: 64, tiles: [{ x: 0, y: 0 }] }, function (tile) {
+                    tiles.push(decodeGrayPng(tile.data));
+                }).then(function () {
+                    var tile = tiles[0];
+                    for (var y = 0; y < tile.height; y++) {
+                        a.deepEqual(tile.rows[y], whole.rows[y].slice(0, 8));
+                    }
+                });
+            });
+        });
+        it('should render bilevel tiff smaller than rgb', function () {
+            this.timeout(0);
+            var rgb = pages[0].renderToBuffer('tiff', 72).data;
+            return pages[0].renderToBufferAsync('tiff', 72, { colorMode: 'mono' })
+                .then(function (out) {
+                    a.ok(out.data.length > 0);
+                    a.ok(out.data.length < rgb.length);
+                });
+        });
+        it('should render gray jpeg', function () {
+            this.timeout(0);
+            a.ok(pages[1].renderToBuffer('jpeg', 72, { colorMode: 'gray' }).data.length > 0);
+        });
+        it('should render on transparent and colored background', function () {
+            this.timeout(0);
+            var png = pages[0].renderToBuffer('png', 72, { background: 'transparent' }).data;
+            // IHDR color type: truecolor with alpha
+            a.equal(png[25], 6);
+            var raw = pages[0].renderToBuffer('raw', 72, { colorMode: 'rgba', background: 'transparent' });
+            // the top left corner is bare paper
+            a.equal(raw.data[3], 0);
+            raw = pages[0].renderToBuffer('raw', 72, { background: [255, 0, 0] });
+            a.deepEqual(Array.prototype.slice.call(raw.data, 0, 3), [255, 0, 0]);
+        });
+        it('should throw on transparent jpeg', function () {
+            this.timeout(0);
+            a.throws(function () {
+                pages[0].renderToBuffer('jpeg', 72, { background: 'transparent' });
+            }, new RegExp('\'background\' can be \'transparent\' only'));
+        });
+        it('should throw on mono jpeg', function () {
+            this.timeout(0);
+            a.throws(function () {
+                pages[0].renderToBuffer('jpeg', 72, { colorMode: 'mono' });
+            }, new RegExp('\'colorMode\' option value must be \'rgb\' or \'gray\''));
+        });
+    });
+    describe('render contexts', function () {
+        it('should render identically with reused contexts', function () {
+            this.timeout(0);
+            var first = pages[0].renderToBuffer('png', 50).data;
+            pages[0].renderToBuffer('png', 100);
+            a.ok(pages[0].renderToBuffer('png', 50).data.equals(first));
+        });
+    });
     describe('render to buffer async', function () {
         it('should render to png', function () {
             this.timeout(0);
@@ -525,6 +1280,82 @@ describe('PopplerPage', function () {
         });
     });
 
+    describe('render cancellation', function () {
+        it('should reject renders past their deadline', function () {
+            this.timeout(0);
+            return pages[0].renderToBufferAsync('png', 72, { deadlineMs: 0 })
+                .then(function () {
+                    a.fail('render should have timed out');
+                }, function (err) {
+                    a.equal(err.code, 'ERR_RENDER_TIMEOUT');
+                });
+        });
+        it('should throw on bad deadline', function () {
+            a.throws(function () {
+                pages[0].renderToBuffer('png', 72, { deadlineMs: -1 });
+            }, new RegExp('\'deadlineMs\' option value must be'));
+        });
+        it('should reject aborted renders', function () {
+            this.timeout(0);
+            if (typeof AbortController === 'undefined') {
+                this.skip();
+            }
+            var controller = new AbortController();
+            var result = pages[0].renderToBufferAsync('png', 600, { signal: controller.signal })
+                .then(function () {
+                    a.fail('render should have been aborted');
+                }, function (err) {
+                    a.equal(err.code, 'ERR_RENDER_ABORTED');
+                });
+            controller.abort();
+            return result;
+        });
+        it('should not leave a file behind an aborted render', function () {
+            this.timeout(0);
+            if (typeof AbortController === 'undefined') {
+                this.skip();
+            }
+            var controller = new AbortController();
+            controller.abort();
+            return pages[0].renderToFileAsync('test/aborted.png', 'png', 72, { signal: controller.signal })
+                .then(function () {
+                    a.fail('render should have been aborted');
+                }, function (err) {
+                    a.equal(err.code, 'ERR_RENDER_ABORTED');
+                    a.ok(!fs.existsSync('test/aborted.png'));
+                });
+        });
+    });
+    describe('concurrent rendering', function () {
+        it('should render one document from many threads', function () {
+            this.timeout(0);
+            var concurrency = poppler.getConcurrency();
+            poppler.setConcurrency(8);
+            var page = new poppler.PopplerDocument(targets[0]).getPage(1);
+            var expected = page.renderToBuffer('png', 72).data;
+            var renders = [];
+            for (var i = 0; i < 64; i++) {
+                renders.push(page.renderToBufferAsync('png', 72));
+            }
+            return Promise.all(renders).then(function (results) {
+                results.forEach(function (out) {
+                    a.ok(expected.equals(out.data));
+                });
+                poppler.setConcurrency(concurrency);
+            });
+        });
+        it('should render annotations added after parallel renders', function () {
+            this.timeout(0);
+            var page = new poppler.PopplerDocument(targets[0]).getPage(1);
+            var plain = page.renderToBuffer('png', 72).data;
+            return page.renderToBufferAsync('png', 72).then(function () {
+                page.addAnnot({ x1: 0.1, x2: 0.5, y1: 0.1, y2: 0.5 });
+                return page.renderToBufferAsync('png', 72);
+            }).then(function (out) {
+                a.ok(!plain.equals(out.data));
+            });
+        });
+    });
     describe('render to promise', function () {
         it('should render png to promise', function () {
             this.timeout(0);